@@ -1,14 +1,32 @@
 #include "JZParser.hpp"
+#include "RegexCache.hpp"
+#include "RenderArena.hpp"
+#include "StructuralScanner.hpp"
+#include "TemplateCache.hpp"
+#include "ThreadPool.hpp"
 #include "ToolsManager.hpp" // assumed available in your project
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <charconv>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <optional>
+#include <span>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
+#include <type_traits>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using namespace std;
@@ -19,8 +37,12 @@ namespace jz {
        Internal helpers
        ------------------------- */
 
-    // sentinel key used to represent `undefined` inside templates
+    /* sentinel key used to represent an undefined result of the public API (to_json of an undefined root);
+       while rendering, undefined is carried out of band (eval::Value flags, CompiledTemplate::render_optional)
+    */
     static constexpr string_view UNDEF_KEY = "__jz_undefined__";
+    // the sentinel as text: undefined placeholders of the text outputs (to_string, render_string)
+    static constexpr string_view UNDEF_TEXT = R"({"__jz_undefined__":true})";
 
     // Create an ordered_json sentinel for undefined
     static ordered_json undefined_sentinel() {
@@ -30,8 +52,9 @@ namespace jz {
     }
 
     static bool is_undefined_sentinel(const ordered_json &j) noexcept {
-        return j.is_object() && j.size() == 1 && j.contains(string(UNDEF_KEY)) &&
-               j.at(string(UNDEF_KEY)).is_boolean() && j.at(string(UNDEF_KEY)).get<bool>() == true;
+        if (!j.is_object() || j.size() != 1) return false;
+        const auto it = j.begin();
+        return it.key() == UNDEF_KEY && it.value().is_boolean() && it.value().get<bool>();
     }
 
     // safe whitespace test
@@ -39,6 +62,24 @@ namespace jz {
         return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
     }
 
+    // advance a 1-based line/column position over run
+    static void advance_position(const string_view run, size_t &line, size_t &col) noexcept {
+        size_t start = 0;
+        while (const void *nl = memchr(run.data() + start, '\n', run.size() - start)) {
+            ++line;
+            col = 1;
+            start = static_cast<const char *>(nl) - run.data() + 1;
+        }
+        col += run.size() - start;
+    }
+
+    // structural bytes of template text: strings, backtick templates and $(...) placeholders
+    static const StructuralScanner TEMPLATE_STRUCTURAL("\"'\\`$()");
+    // structural bytes inside a quoted string
+    static const StructuralScanner STRING_STRUCTURAL("\"'\\");
+    // structural bytes when matching the braces of a tool {...} block
+    static const StructuralScanner BRACE_STRUCTURAL("\"'\\{}");
+
     /* -------------------------
        Scanner with position tracking (1-based)
        ------------------------- */
@@ -76,6 +117,14 @@ namespace jz {
             while (n-- && !eof()) next();
         }
 
+        // jump forward to pos in one step (used with StructuralScanner to skip literal runs)
+        void skip_to(const size_t pos) noexcept {
+            const size_t end = std::min(pos, s.size());
+            if (end <= i) return;
+            advance_position(s.substr(i, end - i), line, col);
+            i = end;
+        }
+
         size_t pos() const noexcept { return i; }
 
         // current line/column describing the character at position i (1-based)
@@ -156,348 +205,487 @@ namespace jz {
         return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
     }
 
-    /* remove_comments:
-       - removes C-like line comments and block comments
-       - respects string literals (single, double, backtick)
-       - throws JZError if block comment is unterminated
-    */
-    string Processor::remove_comments(string_view s) {
-        Scanner sc{s};
-        string out;
-        out.reserve(s.size());
+    /* -------------------------
+       Json5Normalizer
+       Every stage reproduces the historical standalone pass it replaces (same string/escape rules, same
+       quirks), so chaining the stages gives the same output as running the passes one after the other.
+       ------------------------- */
 
-        bool in_line_comment = false;
-        bool in_block_comment = false;
-        bool in_string = false;
-        char string_delim = 0;
-        bool escape = false;
+    Json5Normalizer::Json5Normalizer(const unsigned stages, const size_t reserve) : _stages(stages) {
+        _out.reserve(reserve);
+    }
 
-        while (!sc.eof()) {
-            const char c = sc.next();
-            const char nextc = sc.peek();
+    string Json5Normalizer::run(const string_view s, const unsigned stages) {
+        Json5Normalizer n(stages, s.size());
+        n.append(s);
+        return n.finish();
+    }
 
-            if (in_line_comment) {
-                if (c == '\n') {
-                    in_line_comment = false;
-                    out.push_back(c); // preserve newline
-                } else {
-                    // skip character inside line comment
-                }
-                continue;
-            }
+    // characters that may change the state of some stage, per bulk class (everything else passes through untouched)
+    static const StructuralScanner BULK_SCANNERS[] = {
+        StructuralScanner("/\"'`,{}[]"), // BULK_NORMAL
+        StructuralScanner("\\\"'"), // BULK_STRING
+        StructuralScanner("\n"), // BULK_LINE_COMMENT
+        StructuralScanner("*\n\r"), // BULK_BLOCK_COMMENT
+    };
 
-            if (in_block_comment) {
-                // preserve newlines inside block comments so line numbers remain aligned
-                if (c == '\n') {
-                    out.push_back('\n');
-                    continue;
-                }
-                // handle CRLF: if we see '\r' and next is '\n', treat as newline
-                if (c == '\r') {
-                    if (nextc == '\n') {
-                        // consume the '\n' in the next loop iteration (sc.next() will do it),
-                        // but append a newline now so we preserve line count.
-                        out.push_back('\n');
-                    } else {
-                        out.push_back('\n');
-                    }
+    /* bulk_class:
+       - when every enabled stage is in a state where most characters are copied (or, inside comments,
+         dropped) without any state change, return the class selecting the characters that still need the
+         per-stage path
+       - returns BULK_NONE when the next character must go through the stages one by one
+    */
+    Json5Normalizer::BulkClass Json5Normalizer::bulk_class(bool &emit) const {
+        if (_c_has_pending || !_key.empty() || !_comma.empty()) return BULK_NONE;
+        const bool comments = _stages & STRIP_COMMENTS;
+        const bool quotes = _stages & SINGLE_QUOTES;
+        const bool keys = _stages & QUOTE_KEYS;
+        const bool commas = _stages & TRAILING_COMMAS;
+
+        emit = false;
+        if (comments && _in_line_comment) return BULK_LINE_COMMENT;
+        if (comments && _in_block_comment) return BULK_BLOCK_COMMENT;
+
+        emit = true;
+        if ((!comments || (_c_in_string && !_c_escape && _c_delim != '`')) &&
+            (!quotes || (_q_in_string && !_q_escape)) &&
+            (!keys || (_k_in_string && !_k_escape)) &&
+            (!commas || (_t_in_string && !_t_escape)))
+            return BULK_STRING;
+
+        if ((!comments || !_c_in_string) &&
+            (!quotes || !_q_in_string) &&
+            (!keys || (!_k_in_string && (_stack.empty() || _stack.back().ctx != Ctx::InObject ||
+                                         !_stack.back().expecting_key))) &&
+            (!commas || !_t_in_string))
+            return BULK_NORMAL;
+
+        return BULK_NONE;
+    }
+
+    void Json5Normalizer::append(const string_view chunk) {
+        StructuralScanner::Cursor cursors[] = {
+            {BULK_SCANNERS[BULK_NORMAL], chunk}, {BULK_SCANNERS[BULK_STRING], chunk},
+            {BULK_SCANNERS[BULK_LINE_COMMENT], chunk}, {BULK_SCANNERS[BULK_BLOCK_COMMENT], chunk},
+        };
+        size_t i = 0;
+        while (i < chunk.size()) {
+            bool emit = false;
+            if (const BulkClass bulk = bulk_class(emit); bulk != BULK_NONE) {
+                // copy (or skip) the run of characters that leave every stage untouched
+                if (const size_t stop = cursors[bulk].next(i); stop > i) {
+                    const string_view run = chunk.substr(i, stop - i);
+                    advance_position(run, _line, _col);
+                    if (emit) _out.append(run);
+                    i = stop;
                     continue;
                 }
-                if (c == '*' && nextc == '/') {
-                    sc.advance(); // skip '/'
-                    in_block_comment = false;
-                }
-                // otherwise skip other chars inside comment (do not append)
-                continue;
             }
 
-            if (in_string) {
-                out.push_back(c);
-                if (escape) {
-                    escape = false;
-                } else if (c == '\\') {
-                    escape = true;
-                } else if (c == string_delim) {
-                    in_string = false;
-                    string_delim = 0;
-                }
-                continue;
+            const char c = chunk[i++];
+            if (c == '\n') {
+                ++_line;
+                _col = 1;
+            } else {
+                ++_col;
             }
+            put_comments(c);
+        }
+    }
 
-            // not in comment or string
-            if (c == '/' && nextc == '/') {
-                in_line_comment = true;
-                sc.advance(); // consume second '/'
-                continue;
-            }
-            if (c == '/' && nextc == '*') {
-                in_block_comment = true;
-                sc.advance(); // consume '*'
-                continue;
-            }
-            if (c == '"' || c == '\'' || c == '`') {
-                in_string = true;
-                string_delim = c;
-                out.push_back(c);
-                continue;
-            }
+    string Json5Normalizer::finish() {
+        // position of the last consumed character
+        const auto position_prev = [this]() -> pair<size_t, size_t> {
+            if (_col > 1) return {_line, _col - 1};
+            if (_line == 1) return {1, 1};
+            return {_line - 1, 1};
+        };
 
-            out.push_back(c);
+        if (_c_has_pending) {
+            _c_has_pending = false;
+            step_comments(_c_pending, '\0');
         }
-
-        if (in_block_comment) {
+        if (_in_block_comment) {
             // unterminated block comment: report position at previous character
-            auto [ln, col] = sc.position_prev();
+            auto [ln, col] = position_prev();
             throw JZError("Unterminated block comment", ln, col);
         }
-
-        return out;
+        if (_q_in_string && _q_delim == '\'') {
+            auto [ln, col] = position_prev();
+            throw JZError("Unterminated single-quoted string", ln, col);
+        }
+        // identifier still waiting for its ':' at end of input: not a key
+        while (!_key.empty()) {
+            const string rest = _key.substr(1);
+            const char first = _key[0];
+            _key.clear();
+            _key_ws = string::npos;
+            put_commas(first);
+            for (const char ch: rest) put_keys(ch);
+        }
+        _out.append(_comma);
+        _comma.clear();
+        return std::move(_out);
     }
 
-    /* convert_single_quoted_strings:
-       - convert single-quoted strings to double-quoted JSON-compatible strings
-       - preserves escape sequences
+    /* comments stage:
+       - removes C-like line comments and block comments
+       - respects string literals (single, double, backtick)
+       - needs one character of lookahead after '/' and, inside block comments, after '*'
     */
-    string Processor::convert_single_quoted_strings(string_view s) {
-        Scanner sc{s};
-        string out;
-        out.reserve(s.size());
-
-        bool in_string = false;
-        char delim = 0;
-        bool escape = false;
+    void Json5Normalizer::put_comments(const char c) {
+        if (!(_stages & STRIP_COMMENTS)) {
+            put_quotes(c);
+            return;
+        }
+        if (_c_has_pending) {
+            _c_has_pending = false;
+            if (step_comments(_c_pending, c)) return; // c consumed as second char of '//', '/*' or '*/'
+        }
+        const bool needs_lookahead = _in_block_comment
+                                         ? c == '*'
+                                         : !_in_line_comment && !_c_in_string && c == '/';
+        if (needs_lookahead) {
+            _c_pending = c;
+            _c_has_pending = true;
+            return;
+        }
+        step_comments(c, '\0');
+    }
 
-        while (!sc.eof()) {
-            char c = sc.next();
-            if (!in_string) {
-                if (c == '"' || c == '\'') {
-                    in_string = true;
-                    delim = c;
-                    // if single-quote, emit double-quote instead to make it valid JSON
-                    out.push_back((delim == '\'') ? '"' : '"');
-                    escape = false;
-                    continue;
-                }
-                out.push_back(c);
-                continue;
+    // returns true when nextc has been consumed
+    bool Json5Normalizer::step_comments(const char c, const char nextc) {
+        if (_in_line_comment) {
+            if (c == '\n') {
+                _in_line_comment = false;
+                put_quotes(c); // preserve newline
             }
+            return false;
+        }
 
-            // inside string
-            if (delim == '"') {
-                out.push_back(c);
-                if (escape) escape = false;
-                else if (c == '\\') escape = true;
-                else if (c == '"') {
-                    in_string = false;
-                    delim = 0;
-                }
-                continue;
+        if (_in_block_comment) {
+            // preserve newlines inside block comments so line numbers remain aligned
+            // ('\r' is emitted as a newline as well)
+            if (c == '\n' || c == '\r') {
+                put_quotes('\n');
+                return false;
             }
+            if (c == '*' && nextc == '/') {
+                _in_block_comment = false;
+                return true; // skip '/'
+            }
+            return false;
+        }
 
-            // delim == '\'' (single quoted input) -> convert to double quoted
-            if (escape) {
-                // keep common escapes but ensure JSON-compatibility
-                switch (c) {
-                    case '\'': out.push_back('\'');
-                        break;
-                    case '"': out.append("\\\"");
-                        break;
-                    case '\\': out.append("\\\\");
-                        break;
-                    case 'n': out.append("\\n");
-                        break;
-                    case 'r': out.append("\\r");
-                        break;
-                    case 't': out.append("\\t");
-                        break;
-                    default:
-                        out.push_back('\\');
-                        out.push_back(c);
-                        break;
-                }
-                escape = false;
-                continue;
+        if (_c_in_string) {
+            put_quotes(c);
+            if (_c_escape) {
+                _c_escape = false;
+            } else if (c == '\\') {
+                _c_escape = true;
+            } else if (c == _c_delim) {
+                _c_in_string = false;
+                _c_delim = 0;
             }
+            return false;
+        }
 
-            if (c == '\\') {
-                escape = true;
-                continue;
+        // not in comment or string
+        if (c == '/' && nextc == '/') {
+            _in_line_comment = true;
+            return true; // consume second '/'
+        }
+        if (c == '/' && nextc == '*') {
+            _in_block_comment = true;
+            return true; // consume '*'
+        }
+        if (c == '"' || c == '\'' || c == '`') {
+            _c_in_string = true;
+            _c_delim = c;
+        }
+        put_quotes(c);
+        return false;
+    }
+
+    /* single-quotes stage:
+       - convert single-quoted strings to double-quoted JSON-compatible strings
+       - preserves escape sequences
+    */
+    void Json5Normalizer::put_quotes(const char c) {
+        if (!(_stages & SINGLE_QUOTES)) {
+            put_keys(c);
+            return;
+        }
+        if (!_q_in_string) {
+            if (c == '"' || c == '\'') {
+                _q_in_string = true;
+                _q_delim = c;
+                _q_escape = false;
+                // if single-quote, emit double-quote instead to make it valid JSON
+                put_keys('"');
+                return;
             }
+            put_keys(c);
+            return;
+        }
 
-            if (c == '\'') {
-                // close single-quoted -> emit closing double-quote
-                out.push_back('"');
-                in_string = false;
-                delim = 0;
-                continue;
+        // inside string
+        if (_q_delim == '"') {
+            put_keys(c);
+            if (_q_escape) _q_escape = false;
+            else if (c == '\\') _q_escape = true;
+            else if (c == '"') {
+                _q_in_string = false;
+                _q_delim = 0;
             }
+            return;
+        }
 
-            if (c == '"') {
-                // escape double-quote inside single-quoted string
-                out.append("\\\"");
-            } else {
-                out.push_back(c);
+        // delim == '\'' (single quoted input) -> convert to double quoted
+        if (_q_escape) {
+            // keep common escapes but ensure JSON-compatibility
+            switch (c) {
+                case '\'': put_keys('\'');
+                    break;
+                case '"': put_keys('\\');
+                    put_keys('"');
+                    break;
+                case '\\': put_keys('\\');
+                    put_keys('\\');
+                    break;
+                case 'n': put_keys('\\');
+                    put_keys('n');
+                    break;
+                case 'r': put_keys('\\');
+                    put_keys('r');
+                    break;
+                case 't': put_keys('\\');
+                    put_keys('t');
+                    break;
+                default:
+                    put_keys('\\');
+                    put_keys(c);
+                    break;
             }
+            _q_escape = false;
+            return;
         }
 
-        if (in_string && delim == '\'') {
-            auto [ln, col] = sc.position_prev();
-            throw JZError("Unterminated single-quoted string", ln, col);
+        if (c == '\\') {
+            _q_escape = true;
+            return;
         }
 
-        return out;
+        if (c == '\'') {
+            // close single-quoted -> emit closing double-quote
+            put_keys('"');
+            _q_in_string = false;
+            _q_delim = 0;
+            return;
+        }
+
+        if (c == '"') {
+            // escape double-quote inside single-quoted string
+            put_keys('\\');
+        }
+        put_keys(c);
     }
 
-    /* quote_unquoted_keys:
-       - walk the content and, when inside an object expecting a key, quote identifier-like keys
-         before a ':' character. Keeps whitespace intact.
+    /* keys stage:
+       - when inside an object expecting a key, quote identifier-like keys before a ':' character.
+         Keeps whitespace intact.
+       - an identifier is held in _key until the first character after it (and its whitespace) tells
+         whether it is a key; if not, its first character is emitted and the rest is examined again
     */
-    string Processor::quote_unquoted_keys(string_view s) {
-        string out;
-        out.reserve(s.size());
-
-        enum class Ctx { None, InObject, InArray };
-        struct Frame {
-            Ctx ctx;
-            bool expecting_key;
-        };
-        vector<Frame> stack;
-
-        bool in_string = false;
-        char delim = 0;
-        bool escape = false;
-
-        for (size_t i = 0; i < s.size(); ++i) {
-            const char c = s[i];
-            if (in_string) {
-                out.push_back(c);
-                if (escape) escape = false;
-                else if (c == '\\') escape = true;
-                else if (c == delim) {
-                    in_string = false;
-                    delim = 0;
-                }
+    void Json5Normalizer::put_keys(const char c) {
+        if (!(_stages & QUOTE_KEYS)) {
+            put_commas(c);
+            return;
+        }
+        if (_key.empty()) {
+            step_keys(c);
+            return;
+        }
+        if (scan_key(c)) return;
+
+        // not a key: emit its first char and examine the remaining ones (iteratively) again
+        _replay.assign(_key.begin() + 1, _key.end());
+        _replay.push_back(c);
+        put_commas(_key[0]);
+        _key.clear();
+        _key_ws = string::npos;
+        size_t i = 0;
+        while (i < _replay.size()) {
+            const char ch = _replay[i++];
+            if (_key.empty()) {
+                step_keys(ch);
                 continue;
             }
+            if (scan_key(ch)) continue;
+            string queue(_key.begin() + 1, _key.end());
+            queue.push_back(ch);
+            queue.append(_replay, i);
+            put_commas(_key[0]);
+            _key.clear();
+            _key_ws = string::npos;
+            _replay = std::move(queue);
+            i = 0;
+        }
+        _replay.clear();
+    }
 
-            if (c == '"' || c == '\'') {
-                in_string = true;
-                delim = c;
-                out.push_back(c);
-                continue;
-            }
+    // returns true when c was absorbed into the pending identifier or completed it as a key
+    bool Json5Normalizer::scan_key(const char c) {
+        if (_key_ws == string::npos && Processor::is_identifier_part(c)) {
+            _key.push_back(c);
+            return true;
+        }
+        if (is_space_char(c)) {
+            if (_key_ws == string::npos) _key_ws = _key.size();
+            _key.push_back(c);
+            return true;
+        }
+        if (c != ':') return false;
+
+        const size_t ident_end = _key_ws == string::npos ? _key.size() : _key_ws;
+        put_commas('"');
+        for (size_t i = 0; i < ident_end; ++i) put_commas(_key[i]);
+        put_commas('"');
+        // whitespace between identifier end and ':'
+        for (size_t i = ident_end; i < _key.size(); ++i) put_commas(_key[i]);
+        put_commas(':');
+        _key.clear();
+        _key_ws = string::npos;
+        _stack.back().expecting_key = false;
+        return true;
+    }
 
-            if (c == '{') {
-                out.push_back(c);
-                stack.push_back({Ctx::InObject, true});
-                continue;
-            }
-            if (c == '[') {
-                out.push_back(c);
-                stack.push_back({Ctx::InArray, false});
-                continue;
-            }
-            if (c == '}' || c == ']') {
-                out.push_back(c);
-                if (!stack.empty()) stack.pop_back();
-                continue;
+    void Json5Normalizer::step_keys(const char c) {
+        if (_k_in_string) {
+            put_commas(c);
+            if (_k_escape) _k_escape = false;
+            else if (c == '\\') _k_escape = true;
+            else if (c == _k_delim) {
+                _k_in_string = false;
+                _k_delim = 0;
             }
+            return;
+        }
 
-            if (!stack.empty() && stack.back().ctx == Ctx::InObject) {
-                if (stack.back().expecting_key) {
-                    if (is_space_char(c)) {
-                        out.push_back(c);
-                        continue;
-                    }
-                    if (c == '"' || c == '\'') {
-                        in_string = true;
-                        delim = c;
-                        out.push_back(c);
-                        continue;
-                    }
-                    if (Processor::is_identifier_start(c)) {
-                        size_t j = i + 1;
-                        while (j < s.size() && Processor::is_identifier_part(s[j])) ++j;
-                        size_t k = j;
-                        while (k < s.size() && is_space_char(s[k])) ++k;
-                        if (k < s.size() && s[k] == ':') {
-                            out.push_back('"');
-                            out.append(s.data() + i, j - i);
-                            out.push_back('"');
-                            // append whitespace between identifier end and ':'
-                            if (k > j) out.append(s.data() + j, k - j);
-                            out.push_back(':');
-                            i = k; // main loop will increment i
-                            stack.back().expecting_key = false;
-                            continue;
-                        }
-                    }
-                    out.push_back(c);
-                    continue;
-                } else {
-                    out.push_back(c);
-                    if (c == ',') stack.back().expecting_key = true;
-                    continue;
+        if (c == '"' || c == '\'') {
+            _k_in_string = true;
+            _k_delim = c;
+            put_commas(c);
+            return;
+        }
+
+        if (c == '{') {
+            put_commas(c);
+            _stack.push_back({Ctx::InObject, true});
+            return;
+        }
+        if (c == '[') {
+            put_commas(c);
+            _stack.push_back({Ctx::InArray, false});
+            return;
+        }
+        if (c == '}' || c == ']') {
+            put_commas(c);
+            if (!_stack.empty()) _stack.pop_back();
+            return;
+        }
+
+        if (!_stack.empty() && _stack.back().ctx == Ctx::InObject) {
+            if (_stack.back().expecting_key) {
+                if (Processor::is_identifier_start(c)) {
+                    _key.assign(1, c);
+                    _key_ws = string::npos;
+                    return;
                 }
+            } else if (c == ',') {
+                _stack.back().expecting_key = true;
             }
-
-            out.push_back(c);
         }
 
-        return out;
+        put_commas(c);
     }
 
-    /* remove_trailing_commas:
-       - naive approach: when encountering ']' or '}', walk back and remove a comma immediately before closing
-         (skipping whitespace).
+    /* trailing commas stage:
+       - a ',' (and the whitespace after it) is held back and dropped when ']' or '}' comes next
     */
-    string Processor::remove_trailing_commas(string_view s) {
-        string out;
-        out.reserve(s.size());
-
-        bool in_string = false;
-        char delim = 0;
-        bool escape = false;
-
-        for (size_t i = 0; i < s.size(); ++i) {
-            const char c = s[i];
-            if (in_string) {
-                out.push_back(c);
-                if (escape) escape = false;
-                else if (c == '\\') escape = true;
-                else if (c == delim) {
-                    in_string = false;
-                    delim = 0;
-                }
-                continue;
-            }
-
-            if (c == '"' || c == '\'') {
-                in_string = true;
-                delim = c;
-                out.push_back(c);
-                continue;
+    void Json5Normalizer::put_commas(const char c) {
+        if (!(_stages & TRAILING_COMMAS)) {
+            _out.push_back(c);
+            return;
+        }
+        if (_t_in_string) {
+            _out.push_back(c);
+            if (_t_escape) _t_escape = false;
+            else if (c == '\\') _t_escape = true;
+            else if (c == _t_delim) {
+                _t_in_string = false;
+                _t_delim = 0;
             }
+            return;
+        }
 
-            if (c == ']' || c == '}') {
-                // remove a trailing comma before this bracket, skipping spaces
-                size_t trim = out.size();
-                while (trim > 0 && is_space_char(out[trim - 1])) --trim;
-                if (trim > 0 && out[trim - 1] == ',') {
-                    out.erase(out.begin() + static_cast<long>(trim - 1), out.end());
-                }
-                out.push_back(c);
-                continue;
+        if (!_comma.empty()) {
+            if (is_space_char(c)) {
+                _comma.push_back(c);
+                return;
             }
+            if (c != ']' && c != '}') _out.append(_comma);
+            _comma.clear();
+        }
 
-            out.push_back(c);
+        if (c == '"' || c == '\'') {
+            _t_in_string = true;
+            _t_delim = c;
+        } else if (c == ',') {
+            _comma.assign(1, c);
+            return;
         }
+        _out.push_back(c);
+    }
 
-        return out;
+    /* -------------------------
+       Historical normalization passes: thin wrappers over Json5Normalizer
+       ------------------------- */
+
+    /* remove_comments:
+       - removes C-like line comments and block comments
+       - respects string literals (single, double, backtick)
+       - throws JZError if block comment is unterminated
+    */
+    string Processor::remove_comments(const string_view s) {
+        return Json5Normalizer::run(s, Json5Normalizer::STRIP_COMMENTS);
+    }
+
+    /* convert_single_quoted_strings:
+       - convert single-quoted strings to double-quoted JSON-compatible strings
+       - preserves escape sequences
+    */
+    string Processor::convert_single_quoted_strings(const string_view s) {
+        return Json5Normalizer::run(s, Json5Normalizer::SINGLE_QUOTES);
+    }
+
+    /* quote_unquoted_keys:
+       - walk the content and, when inside an object expecting a key, quote identifier-like keys
+         before a ':' character. Keeps whitespace intact.
+    */
+    string Processor::quote_unquoted_keys(const string_view s) {
+        return Json5Normalizer::run(s, Json5Normalizer::QUOTE_KEYS);
+    }
+
+    /* remove_trailing_commas:
+       - remove a comma immediately before a closing ']' or '}' (skipping whitespace).
+    */
+    string Processor::remove_trailing_commas(const string_view s) {
+        return Json5Normalizer::run(s, Json5Normalizer::TRAILING_COMMAS);
     }
 
     string Processor::normalize_json5_to_json(const string_view s) {
-        return remove_trailing_commas(quote_unquoted_keys(convert_single_quoted_strings(s)));
+        return Json5Normalizer::run(s, Json5Normalizer::JSON5);
     }
 
     /* -------------------------
@@ -514,38 +702,52 @@ namespace jz {
        ------------------------- */
 
     namespace eval {
+        /* Value: result of an expression.
+           Borrows nodes of the input data or of the compiled constants (ref) and owns only computed
+           temporaries (own); a copy is made when the value is materialized into the output (take).
+        */
         struct Value {
-            bool missing = false;
-            ordered_json j;
-            static Value from_json(ordered_json v) { return Value{false, std::move(v)}; }
-            static Value missing_value() { return Value{true, ordered_json(nullptr)}; }
+            bool missing = false; // unresolved path: null inside literals, undefined elsewhere
+            bool undefined = false; // the `undefined` literal, or a tool/nested render producing undefined
+            const ordered_json *ref = nullptr; // borrowed, when set
+            ordered_json own;
+
+            [[nodiscard]] const ordered_json &j() const noexcept { return ref ? *ref : own; }
+
+            // materialize: copy a borrowed value, move an owned one
+            ordered_json take() && { return ref ? *ref : std::move(own); }
+
+            static Value from_json(ordered_json v) { return Value{false, false, nullptr, std::move(v)}; }
+            static Value borrow(const ordered_json &v) { return Value{false, false, &v, ordered_json()}; }
+            static Value missing_value() { return Value{true, false, nullptr, ordered_json(nullptr)}; }
+            static Value undefined_value() { return Value{false, true, nullptr, ordered_json(nullptr)}; }
         };
 
-        static bool is_undefined(const Value &v) { return v.missing || is_undefined_sentinel(v.j); }
+        static bool is_undefined(const Value &v) { return v.missing || v.undefined; }
         static bool is_nullish(const Value &v) { return v.missing || is_undefined(v); }
 
         static bool is_truthy(const Value &v) {
             if (v.missing) return false;
             if (is_undefined(v)) return false;
-            if (v.j.is_boolean()) return v.j.get<bool>();
-            if (v.j.is_null()) return false;
-            if (v.j.is_number()) {
-                try { return v.j.get<double>() != 0.0; } catch (...) { return true; }
+            if (v.j().is_boolean()) return v.j().get<bool>();
+            if (v.j().is_null()) return false;
+            if (v.j().is_number()) {
+                try { return v.j().get<double>() != 0.0; } catch (...) { return true; }
             }
-            if (v.j.is_string()) return !v.j.get_ref<const string &>().empty();
-            if (v.j.is_array() || v.j.is_object()) return true;
+            if (v.j().is_string()) return !v.j().get_ref<const string &>().empty();
+            if (v.j().is_array() || v.j().is_object()) return true;
             return true;
         }
 
         static optional<double> to_number_opt(const Value &v) {
             if (v.missing) return nullopt;
             if (is_undefined(v)) return nullopt;
-            if (v.j.is_number()) {
-                try { return v.j.get<double>(); } catch (...) { return nullopt; }
+            if (v.j().is_number()) {
+                try { return v.j().get<double>(); } catch (...) { return nullopt; }
             }
-            if (v.j.is_boolean()) return v.j.get<bool>() ? 1.0 : 0.0;
-            if (v.j.is_string()) {
-                const string &s = v.j.get_ref<const string &>();
+            if (v.j().is_boolean()) return v.j().get<bool>() ? 1.0 : 0.0;
+            if (v.j().is_string()) {
+                const string &s = v.j().get_ref<const string &>();
                 if (s.empty()) return 0.0;
                 try {
                     size_t idx = 0;
@@ -563,15 +765,15 @@ namespace jz {
             if (is_undefined(a) && is_undefined(b)) return true;
 
             if (!a.missing && !is_undefined(a) && !b.missing && !is_undefined(b)) {
-                if (a.j.type() == b.j.type()) return a.j == b.j;
+                if (a.j().type() == b.j().type()) return a.j() == b.j();
             }
 
             auto an = to_number_opt(a);
             auto bn = to_number_opt(b);
             if (an && bn) return *an == *bn;
 
-            string sa = a.missing ? string("missing") : (is_undefined(a) ? string("undefined") : a.j.dump());
-            string sb = b.missing ? string("missing") : (is_undefined(b) ? string("undefined") : b.j.dump());
+            string sa = a.missing ? string("missing") : (is_undefined(a) ? string("undefined") : a.j().dump());
+            string sb = b.missing ? string("missing") : (is_undefined(b) ? string("undefined") : b.j().dump());
             return sa == sb;
         }
 
@@ -588,10 +790,10 @@ namespace jz {
                     default: return nullopt;
                 }
             }
-            if (!a.missing && !is_undefined(a) && a.j.is_string() && !b.missing && !is_undefined(b) && b.j.
+            if (!a.missing && !is_undefined(a) && a.j().is_string() && !b.missing && !is_undefined(b) && b.j().
                 is_string()) {
-                const string &A = a.j.get_ref<const string &>();
-                const string &B = b.j.get_ref<const string &>();
+                const string &A = a.j().get_ref<const string &>();
+                const string &B = b.j().get_ref<const string &>();
                 switch (op) {
                     case '<': return A < B;
                     case '>': return A > B;
@@ -603,18 +805,46 @@ namespace jz {
             return nullopt;
         }
 
+        /* Symbols: per-template table of interned path keys
+           - every identifier (and bracketed key) of a template's paths is stored once; the compiled paths point
+             into the table, which lives as long as the compiled template
+        */
+        class Symbols {
+        public:
+            const string &intern(const string_view name) {
+                if (const auto it = _names.find(name); it != _names.end()) return *it->second;
+                auto owned = make_unique<const string>(name);
+                const string &interned = *owned;
+                _names.emplace(interned, std::move(owned));
+                return interned;
+            }
+
+            // approximate memory used (template cache budget)
+            [[nodiscard]] size_t memory_size() const noexcept {
+                size_t n = sizeof(Symbols);
+                for (const auto &[name, owned]: _names) n += sizeof(string) + 2 * sizeof(void *) + name.size();
+                return n;
+            }
+
+        private:
+            unordered_map<string_view, unique_ptr<const string>> _names; // views of the owned strings
+        };
+
         /* Token, Lexer, Parser:
            compact implementation focusing on clarity and position tracking where errors are thrown.
+           Token text is a view of the expression source, or of a lexer buffer for strings that needed
+           unescaping: lexing does not allocate otherwise.
         */
         struct Token {
             enum Type {
                 T_EOF, T_IDENTIFIER, T_NUMBER, T_STRING, T_TRUE, T_FALSE, T_NULL, T_UNDEFINED,
                 T_QMARK, T_COLON, T_DOT, T_LPAREN, T_RPAREN, T_LBRACKET, T_RBRACKET, T_LBRACE, T_RBRACE, T_TEMPLATE,
-                T_COMMA, T_PIPE, T_HASH, T_OR, T_AND, T_NOT, T_NULLISH, T_EQ, T_NE, T_GT, T_LT, T_GTE, T_LTE, T_ASSIGN
+                T_COMMA, T_PIPE, T_HASH, T_OR, T_AND, T_NOT, T_NULLISH, T_EQ, T_NE, T_GT, T_LT, T_GTE, T_LTE, T_ASSIGN,
+                T_MATCH
             };
 
             Type type;
-            string text;
+            string_view text; // valid while the lexer is
             size_t line = 1;
             size_t col = 1;
         };
@@ -624,6 +854,7 @@ namespace jz {
             size_t i = 0;
             size_t line = 1;
             size_t col = 1;
+            std::deque<string> unescaped; // text of the string/template tokens that had escapes
 
             explicit Lexer(const string_view src) : s(src) {
             }
@@ -649,10 +880,10 @@ namespace jz {
                 }
             }
 
-            Token make_token(const Token::Type t, string text = {}) const {
+            Token make_token(const Token::Type t, const string_view text = {}) const {
                 Token tok;
                 tok.type = t;
-                tok.text = std::move(text);
+                tok.text = text;
                 tok.line = line;
                 tok.col = col;
                 return tok;
@@ -693,6 +924,12 @@ namespace jz {
                     col += 2;
                     return Token{Token::T_EQ, "==", l, co};
                 }
+                if (c == '=' && peek(1) == '~') {
+                    size_t l = line, co = col;
+                    i += 2;
+                    col += 2;
+                    return Token{Token::T_MATCH, "=~", l, co};
+                }
                 if (c == '!' && peek(1) == '=') {
                     size_t l = line, co = col;
                     i += 2;
@@ -716,27 +953,33 @@ namespace jz {
                     const size_t start_col = col;
                     ++i;
                     ++col; // consume backtick
-                    std::string acc;
+                    const size_t begin = i;
+                    string *acc = nullptr; // unescaped text, from the first escape on
                     bool esc = false;
                     while (i < s.size()) {
+                        const size_t at = i;
                         const char ch = s[i++];
                         if (ch == '\n') {
                             ++line;
                             col = 1;
                         } else ++col;
                         if (esc) {
-                            acc.push_back(ch);
+                            acc->push_back(ch);
                             esc = false;
                             continue;
                         }
                         if (ch == '\\') {
+                            if (!acc) acc = &unescaped.emplace_back(s.substr(begin, at - begin));
                             esc = true;
                             continue;
                         }
                         if (ch == '`') {
-                            return Token{Token::T_TEMPLATE, std::move(acc), start_line, start_col};
+                            return Token{
+                                Token::T_TEMPLATE, acc ? string_view(*acc) : s.substr(begin, at - begin),
+                                start_line, start_col
+                            };
                         }
-                        acc.push_back(ch);
+                        if (acc) acc->push_back(ch);
                     }
                     throw JZError("Unterminated template string", start_line, start_col);
                 }
@@ -777,9 +1020,11 @@ namespace jz {
                     char delim = c;
                     ++i;
                     ++col; // skip delim
-                    string acc;
+                    const size_t begin = i;
+                    string *acc = nullptr; // unescaped text, from the first escape on
                     bool esc = false;
                     while (i < s.size()) {
+                        const size_t at = i;
                         char ch = s[i++];
                         if (ch == '\n') {
                             ++line;
@@ -787,45 +1032,49 @@ namespace jz {
                         } else ++col;
                         if (esc) {
                             switch (ch) {
-                                case '"': acc.push_back('"');
+                                case '"': acc->push_back('"');
                                     break;
-                                case '\\': acc.push_back('\\');
+                                case '\\': acc->push_back('\\');
                                     break;
-                                case '/': acc.push_back('/');
+                                case '/': acc->push_back('/');
                                     break;
-                                case 'b': acc.push_back('\b');
+                                case 'b': acc->push_back('\b');
                                     break;
-                                case 'f': acc.push_back('\f');
+                                case 'f': acc->push_back('\f');
                                     break;
-                                case 'n': acc.push_back('\n');
+                                case 'n': acc->push_back('\n');
                                     break;
-                                case 'r': acc.push_back('\r');
+                                case 'r': acc->push_back('\r');
                                     break;
-                                case 't': acc.push_back('\t');
+                                case 't': acc->push_back('\t');
                                     break;
                                 case 'u':
                                     // copy \uXXXX as-is
-                                    acc.push_back('\\');
-                                    acc.push_back('u');
+                                    acc->push_back('\\');
+                                    acc->push_back('u');
                                     for (int k = 0; k < 4 && i < s.size(); ++k) {
-                                        acc.push_back(s[i++]);
+                                        acc->push_back(s[i++]);
                                         ++col;
                                     }
                                     break;
-                                default: acc.push_back(ch);
+                                default: acc->push_back(ch);
                                     break;
                             }
                             esc = false;
                             continue;
                         }
                         if (ch == '\\') {
+                            if (!acc) acc = &unescaped.emplace_back(s.substr(begin, at - begin));
                             esc = true;
                             continue;
                         }
                         if (ch == delim) {
-                            return Token{Token::T_STRING, std::move(acc), start_line, start_col};
+                            return Token{
+                                Token::T_STRING, acc ? string_view(*acc) : s.substr(begin, at - begin),
+                                start_line, start_col
+                            };
                         }
-                        acc.push_back(ch);
+                        if (acc) acc->push_back(ch);
                     }
                     throw JZError("Unterminated string literal", start_line, start_col);
                 }
@@ -861,7 +1110,7 @@ namespace jz {
                             ++col;
                         }
                     }
-                    return Token{Token::T_NUMBER, string(s.substr(start, i - start)), start_line, start_col};
+                    return Token{Token::T_NUMBER, s.substr(start, i - start), start_line, start_col};
                 }
 
                 // identifier or keywords
@@ -874,12 +1123,12 @@ namespace jz {
                         ++i;
                         ++col;
                     }
-                    string id = string(s.substr(start, i - start));
+                    const string_view id = s.substr(start, i - start);
                     if (id == "true") return Token{Token::T_TRUE, id, start_line, start_col};
                     if (id == "false") return Token{Token::T_FALSE, id, start_line, start_col};
                     if (id == "null") return Token{Token::T_NULL, id, start_line, start_col};
                     if (id == "undefined") return Token{Token::T_UNDEFINED, id, start_line, start_col};
-                    return Token{Token::T_IDENTIFIER, std::move(id), start_line, start_col};
+                    return Token{Token::T_IDENTIFIER, id, start_line, start_col};
                 }
 
                 // unexpected character
@@ -887,28 +1136,86 @@ namespace jz {
             }
         };
 
-        /* Parser: recursive descent parser for expressions */
-        struct Parser {
-            Lexer lex;
-            Token cur;
-            json &metadata;
-            const ordered_json &data;
+        /* Node: parsed expression tree.
+           Built by Parser and lowered to bytecode by Compiler (see Program); never mutated after parsing.
+        */
+        struct Node;
+        using NodePtr = std::unique_ptr<const Node>;
 
-            // NEW: gate to enable/disable tool execution during parsing
-            bool enable_tools = true;
+        // literal text (expr == nullptr) or $(...) expression inside a template literal
+        struct TemplatePart {
+            string text;
+            NodePtr expr;
+        };
 
-            // RAII scope to toggle tool execution
-            struct ToolExecScope {
-                Parser *self;
-                bool prev;
+        struct ToolOption {
+            string name;
+            NodePtr expr;
+        };
 
-                explicit ToolExecScope(Parser *s, bool enabled)
-                    : self(s), prev(s->enable_tools) { self->enable_tools = enabled; }
+        struct ToolStep {
+            string name; // empty for anonymous tools
+            vector<ToolOption> options;
+            bool has_block = false;
+            string block; // raw '{...}' context (without the outer braces)
+            size_t line = 1; // position reported on tool/context errors
+            size_t col = 1;
+        };
+
+        struct ObjectEntry {
+            string key; // static key
+            NodePtr key_expr; // dynamic $(...) key, when present
+            NodePtr value;
+            size_t line = 1;
+            size_t col = 1;
+        };
 
-                ~ToolExecScope() { self->enable_tools = prev; }
+        struct Node {
+            enum Kind {
+                N_LITERAL, N_UNDEFINED, N_ROOT, N_PATH, N_NOT, N_EQ, N_NE, N_LT, N_GT, N_LTE, N_GTE,
+                N_OR, N_AND, N_NULLISH, N_TERNARY, N_OBJECT, N_ARRAY, N_TEMPLATE, N_PIPELINE, N_MATCH
             };
 
-            explicit Parser(const string_view expr, const ordered_json &d, json &m) : lex(expr), metadata(m), data(d) {
+            Kind kind;
+            ordered_json value; // N_LITERAL
+            vector<const string *> path; // N_PATH, interned keys
+            vector<NodePtr> children; // operands, array elements, pipeline input
+            vector<ObjectEntry> entries; // N_OBJECT
+            vector<TemplatePart> parts; // N_TEMPLATE
+            vector<ToolStep> steps; // N_PIPELINE
+            shared_ptr<const Regex> regex; // N_MATCH with a constant pattern, compiled when parsed
+            size_t line = 1; // N_MATCH: position of the operator
+            size_t col = 1;
+
+            explicit Node(const Kind k) : kind(k) {
+            }
+        };
+
+        static NodePtr make_node(const Node::Kind k, NodePtr a = nullptr, NodePtr b = nullptr, NodePtr c = nullptr) {
+            auto n = std::make_unique<Node>(k);
+            if (a) n->children.push_back(std::move(a));
+            if (b) n->children.push_back(std::move(b));
+            if (c) n->children.push_back(std::move(c));
+            return n;
+        }
+
+        static NodePtr make_literal(ordered_json v) {
+            auto n = std::make_unique<Node>(Node::N_LITERAL);
+            n->value = std::move(v);
+            return n;
+        }
+
+        static vector<TemplatePart> compile_template(string_view raw, Symbols &symbols);
+
+        struct Program;
+
+        /* Parser: recursive descent parser for expressions, producing a Node tree */
+        struct Parser {
+            Lexer lex;
+            Token cur;
+            Symbols &symbols; // path keys are interned here
+
+            Parser(const string_view expr, Symbols &symbols_) : lex(expr), symbols(symbols_) {
                 cur = lex.next();
             }
 
@@ -936,7 +1243,10 @@ namespace jz {
                 bool in_str = false;
                 char delim = 0;
                 bool esc = false;
+                StructuralScanner::Cursor cursor(BRACE_STRUCTURAL, s);
                 while (pos < s.size()) {
+                    if (!esc) pos = cursor.next(pos); // nothing but quotes, backslashes and braces matters here
+                    if (pos >= s.size()) break;
                     char c = s[pos++];
                     if (in_str) {
                         if (esc) {
@@ -967,161 +1277,142 @@ namespace jz {
                 throw JZError("Unterminated '{...}' block in tool context", cur.line, cur.col);
             }
 
-            Value parse_expr() { return parse_ternary(); }
+            NodePtr parse_expr() { return parse_ternary(); }
 
-            // Short-circuit ternary: only evaluate the selected branch
-            Value parse_ternary() {
-                Value cond = parse_or();
+            NodePtr parse_ternary() {
+                NodePtr cond = parse_or();
                 if (cur.type == Token::T_QMARK) {
                     match(Token::T_QMARK);
-                    if (is_truthy(cond)) {
-                        Value thenv = parse_expr();
-                        consume(Token::T_COLON, ":");
-                        // Parse and discard else branch with tools disabled
-                        {
-                            ToolExecScope _(this, false);
-                            (void) parse_expr();
-                        }
-                        return thenv;
-                    } else {
-                        // Parse and discard then branch with tools disabled
-                        {
-                            ToolExecScope _(this, false);
-                            (void) parse_expr();
-                        }
-                        consume(Token::T_COLON, ":");
-                        Value elsev = parse_expr();
-                        return elsev;
-                    }
+                    NodePtr thenn = parse_expr();
+                    consume(Token::T_COLON, ":");
+                    NodePtr elsen = parse_expr();
+                    return make_node(Node::N_TERNARY, std::move(cond), std::move(thenn), std::move(elsen));
                 }
                 return cond;
             }
 
-            // Short-circuit OR: skip right when left is truthy
-            Value parse_or() {
-                Value left = parse_and();
+            NodePtr parse_or() {
+                NodePtr left = parse_and();
                 while (cur.type == Token::T_OR) {
                     match(Token::T_OR);
-                    if (is_truthy(left)) {
-                        ToolExecScope _(this, false);
-                        (void) parse_and(); // consume tokens without running tools
-                    } else {
-                        left = parse_and(); // evaluate right
-                    }
+                    left = make_node(Node::N_OR, std::move(left), parse_and());
                 }
                 return left;
             }
 
-            // Short-circuit AND: skip right when left is falsy
-            Value parse_and() {
-                Value left = parse_nullish();
+            NodePtr parse_and() {
+                NodePtr left = parse_nullish();
                 while (cur.type == Token::T_AND) {
                     match(Token::T_AND);
-                    if (is_truthy(left)) {
-                        left = parse_nullish(); // evaluate right
-                    } else {
-                        ToolExecScope _(this, false);
-                        (void) parse_nullish(); // consume tokens without running tools
-                    }
+                    left = make_node(Node::N_AND, std::move(left), parse_nullish());
                 }
                 return left;
             }
 
-            // Short-circuit nullish coalescing: skip right when left is not nullish
-            Value parse_nullish() {
-                Value left = parse_equality();
+            NodePtr parse_nullish() {
+                NodePtr left = parse_equality();
                 if (cur.type == Token::T_NULLISH) {
                     match(Token::T_NULLISH);
-                    if (!is_nullish(left)) {
-                        ToolExecScope _(this, false);
-                        (void) parse_equality(); // consume tokens without running tools
-                        return left;
-                    } else {
-                        return parse_equality(); // evaluate right
-                    }
+                    return make_node(Node::N_NULLISH, std::move(left), parse_equality());
                 }
                 return left;
             }
 
-            Value parse_equality() {
-                Value left = parse_relational();
-                while (cur.type == Token::T_EQ || cur.type == Token::T_NE) {
-                    Token::Type op = cur.type;
+            NodePtr parse_equality() {
+                NodePtr left = parse_relational();
+                while (cur.type == Token::T_EQ || cur.type == Token::T_NE || cur.type == Token::T_MATCH) {
+                    if (cur.type == Token::T_MATCH) {
+                        left = parse_match(std::move(left));
+                        continue;
+                    }
+                    const Node::Kind k = cur.type == Token::T_EQ ? Node::N_EQ : Node::N_NE;
                     cur = lex.next();
-                    Value right = parse_relational();
-                    bool res = (op == Token::T_EQ) ? eq_values(left, right) : !eq_values(left, right);
-                    left = Value::from_json(ordered_json(res));
+                    left = make_node(k, std::move(left), parse_relational());
                 }
                 return left;
             }
 
-            Value parse_relational() {
-                Value left = parse_unary();
+            // subject =~ pattern: a string literal pattern is compiled here (errors point at the operator)
+            NodePtr parse_match(NodePtr subject) {
+                const size_t line = cur.line, col = cur.col;
+                match(Token::T_MATCH);
+                auto n = std::make_unique<Node>(Node::N_MATCH);
+                n->children.push_back(std::move(subject));
+                n->children.push_back(parse_relational());
+                n->line = line;
+                n->col = col;
+                const Node &pattern = *n->children[1];
+                if (pattern.kind == Node::N_LITERAL && pattern.value.is_string()) {
+                    try {
+                        n->regex = RegexCache::instance().get(pattern.value.get_ref<const string &>());
+                    } catch (const exception &e) {
+                        throw JZError(std::format("Invalid regular expression: {}", e.what()), line, col);
+                    }
+                }
+                return n;
+            }
+
+            NodePtr parse_relational() {
+                NodePtr left = parse_unary();
                 while (cur.type == Token::T_LT || cur.type == Token::T_GT || cur.type == Token::T_LTE || cur.type ==
                        Token::T_GTE) {
-                    Token::Type op = cur.type;
+                    const Node::Kind k = (cur.type == Token::T_LT)
+                                             ? Node::N_LT
+                                             : (cur.type == Token::T_GT)
+                                                   ? Node::N_GT
+                                                   : (cur.type == Token::T_LTE)
+                                                         ? Node::N_LTE
+                                                         : Node::N_GTE;
                     cur = lex.next();
-                    Value right = parse_unary();
-                    char opcode = (op == Token::T_LT)
-                                      ? '<'
-                                      : (op == Token::T_GT)
-                                            ? '>'
-                                            : (op == Token::T_LTE)
-                                                  ? 'l'
-                                                  : 'g';
-                    auto cmp = relational_compare(left, right, opcode);
-                    bool res = cmp.has_value() ? cmp.value() : false;
-                    left = Value::from_json(ordered_json(res));
+                    left = make_node(k, std::move(left), parse_unary());
                 }
                 return left;
             }
 
-            Value parse_unary() {
+            NodePtr parse_unary() {
                 if (cur.type == Token::T_NOT) {
                     match(Token::T_NOT);
-                    const Value v = parse_unary();
-                    bool r = !is_truthy(v);
-                    return Value::from_json(ordered_json(r));
+                    return make_node(Node::N_NOT, parse_unary());
                 }
                 return parse_pipeline();
             }
 
             // pipeline: primary (| #tool(...){...})*
-            // Pipeline: run tool only if enabled and input not undefined
-            Value parse_pipeline() {
-                Value left = parse_primary();
+            NodePtr parse_pipeline() {
+                NodePtr left = parse_primary();
+                if (cur.type != Token::T_PIPE) return left;
+
+                auto pipeline = std::make_unique<Node>(Node::N_PIPELINE);
+                pipeline->children.push_back(std::move(left));
                 while (cur.type == Token::T_PIPE) {
                     match(Token::T_PIPE);
                     if (cur.type != Token::T_HASH)
                         throw JZError("Expected '#' before tool name in pipeline", cur.line, cur.col);
                     match(Token::T_HASH);
 
+                    ToolStep step;
                     // Accept identifier or '{' (empty tool name with immediate context)
-                    std::string toolname;
                     if (cur.type == Token::T_IDENTIFIER) {
-                        toolname = cur.text;
+                        step.name = cur.text;
                         cur = lex.next();
                     } else if (cur.type == Token::T_LBRACE || cur.type == Token::T_LPAREN) {
-                        toolname = std::string(); // empty tool name
-                        // fall-through to context parsing below
+                        // empty tool name: fall-through to context parsing below
                     } else {
                         throw JZError("Expected tool identifier or '{' after '#'", cur.line, cur.col);
                     }
 
                     // Parse options
-                    ordered_json options = ordered_json::object();
                     if (cur.type == Token::T_LPAREN) {
                         match(Token::T_LPAREN);
                         while (cur.type != Token::T_RPAREN) {
                             if (cur.type != Token::T_IDENTIFIER)
                                 throw JZError("Expected option name in tool options", cur.line, cur.col);
-                            string optname = cur.text;
+                            string optname(cur.text);
                             cur = lex.next();
                             if (cur.type != Token::T_ASSIGN)
                                 throw JZError("Expected '=' in tool option", cur.line, cur.col);
                             cur = lex.next();
-                            Value optval = parse_expr(); // respects enable_tools
-                            options[optname] = optval.j;
+                            step.options.push_back({std::move(optname), parse_expr()});
                             if (cur.type == Token::T_COMMA) {
                                 match(Token::T_COMMA);
                                 continue;
@@ -1130,15 +1421,15 @@ namespace jz {
                         consume(Token::T_RPAREN, ")");
                     }
 
-                    ordered_json ctx = ordered_json::object();
-                    string raw_block;
+                    // Extract the raw context block; it is processed as a JZ template when the tool runs
                     if (cur.type == Token::T_LBRACE) {
                         try {
                             size_t block_start = lex.i;
                             size_t block_end = find_matching_brace_pos_in_source();
-                            raw_block = string(lex.s.substr(block_start, block_end - block_start));
+                            step.block = string(lex.s.substr(block_start, block_end - block_start));
+                            step.has_block = true;
                             lex.i = block_end + 1;
-                            for (char ch: raw_block) {
+                            for (char ch: step.block) {
                                 if (ch == '\n') {
                                     ++lex.line;
                                     lex.col = 1;
@@ -1146,150 +1437,25 @@ namespace jz {
                             }
                             if (block_end < lex.s.size() && lex.s[block_end] == '}') { ++lex.col; }
                             cur = lex.next();
-                            // // ltrim and check for enclosing braces
-                            // const auto it = ranges::find_if(raw_block, [](char c) {
-                            //     return !isspace<char>(c, locale::classic());
-                            // });
-                            // raw_block.erase(raw_block.begin(), it);
-                            // if (raw_block.empty() || (raw_block[0] != '[' && raw_block[0] != '{')) {
-                            //     raw_block.insert(raw_block.begin(), '{');
-                            //     raw_block.push_back('}');
-                            // }
-
-                            // parse context JSON from raw_block
-                            if (!toolname.empty() && toolname[0] == '$') {
-                                // modifier '$' tools: merge input data into context
-                                if (!left.j.is_null()) {
-                                    // input data can be merged into a specific context key or at top level
-                                    if (options.contains("$key")) {
-                                        ordered_json _data(data);
-                                        _data[options["$key"].get<string>()] = left.j;
-                                        // parse merged context JSON from raw_block
-                                        ctx = Processor::to_json(raw_block, _data, metadata);
-                                    } else if (!left.j.is_array()) {
-                                        // if input data are not an array and not empty, merge at top level
-                                        // (array can be merged only into a specific key)
-                                        if (!left.j.empty()) {
-                                            ordered_json _data(data);
-                                            _data.merge_patch(left.j);
-                                            // parse merged context JSON from raw_block
-                                            ctx = Processor::to_json(raw_block, _data, metadata);
-                                        } else {
-                                            // parse context JSON from raw_block
-                                            ctx = Processor::to_json(raw_block, data, metadata);
-                                        }
-                                    }
-                                }
-                            } else if (!toolname.empty()) {
-                                // parse merged context JSON from raw_block only if the tool is not anonymous
-                                ctx = Processor::to_json(raw_block, data, metadata);
-                            }
                         } catch (const JZError &e) {
-                            throw JZError(toolname, e, cur.line);
-                        } catch (const exception &e) {
-                            throw JZError(std::format("Tool '{}' error parsing context: [{}]", toolname, e.what()),
-                                          cur.line, cur.col);
+                            throw JZError(step.name, e, cur.line);
                         }
                     }
 
-                    if (is_undefined(left)) {
-                        // keep undefined sentinel; skip calling the tool
-                    } else if (enable_tools) {
-                        ordered_json in_val = left.j;
-                        ordered_json out_val;
-                        try {
-                            if (toolname == "$") {
-                                // anonymous tool: context was not processed beforehand; use context instruction to process input
-                                // the '$' modifier indicates that global context is available
-                                // '$loop' option tells to the anonymous tool if array input must be processed as items (default) or as a whole
-                                const auto _loop = options.contains("$loop")
-                                                       ? options["$loop"].get<bool>()
-                                                       : true;
-                                if (_loop && left.j.is_array()) {
-                                    // put each array item into '$key' if given
-                                    const auto _key = options.contains("$key")
-                                                          ? options["$key"].get<string>()
-                                                          : string();
-                                    // put current index into each item if '$index' option is given
-                                    const auto _idx = options.contains("$index")
-                                                          ? options["$index"].get<string>()
-                                                          : string();
-                                    // special '$' tool: process each array item separately
-                                    for (size_t idx = 0; idx < left.j.size(); ++idx) {
-                                        const auto &item = left.j[idx];
-                                        ordered_json _item(data);
-                                        if (!_idx.empty())
-                                            _item[_idx] = idx;
-                                        if (!_key.empty())
-                                            _item[_key] = item;
-                                        else
-                                            _item.merge_patch(item);
-                                        // cout << "====>>> " << raw_block << endl;
-                                        const auto val = Processor::to_json(raw_block, _item, metadata);
-                                        out_val.push_back(val);
-                                    }
-                                    // cout << "++++>>> " << out_val << endl;
-                                } else {
-                                    out_val = ctx;
-                                }
-                            } else if (toolname.empty()) {
-                                // anonymous tool: context was not processed beforehand; use context instruction to process input
-                                // please note that global context is not available
-                                // 'loop' option tells to the anonymous tool if array input must be processed as items (default) or as a whole
-                                const auto _loop = options.contains("loop")
-                                                       ? options["loop"].get<bool>()
-                                                       : true;
-                                if (_loop && left.j.is_array()) {
-                                    // put each array item into '$key' if given
-                                    const auto _key = options.contains("key")
-                                                          ? options["key"].get<string>()
-                                                          : string();
-                                    // put current index into each item if 'index' option is given
-                                    const auto _idx = options.contains("index")
-                                                          ? options["index"].get<string>()
-                                                          : string();
-                                    // process each array item separately
-                                    for (size_t idx = 0; idx < left.j.size(); ++idx) {
-                                        const auto &item = left.j[idx];
-                                        if (!_idx.empty() || !_key.empty()) {
-                                            ordered_json _item;
-                                            if (!_idx.empty())
-                                                _item[_idx] = idx;
-                                            if (!_key.empty())
-                                                _item[_key] = item;
-                                            else
-                                                _item.merge_patch(item);
-                                            out_val.push_back(Processor::to_json(raw_block, _item, metadata));
-                                        } else
-                                            out_val.push_back(Processor::to_json(raw_block, item, metadata));
-                                    }
-                                } else {
-                                    out_val = Processor::to_json(raw_block, left.j, metadata);
-                                }
-                            } else {
-                                out_val = ToolsManager::instance().run_tool(
-                                    toolname[0] == '$' ? toolname.substr(1) : toolname, in_val, options, ctx, metadata);
-                            }
-                        } catch (const JZError &e) {
-                            throw JZError(toolname, e, cur.line);
-                        } catch (const std::exception &e) {
-                            throw JZError(std::format("Tool '{}' failed: {}", toolname, e.what()), cur.line, cur.col);
-                        }
-                        left = Value::from_json(std::move(out_val));
-                    } else {
-                        // tools disabled: parse syntactically, do not execute; leave 'left' unchanged
-                    }
+                    step.line = cur.line;
+                    step.col = cur.col;
+                    pipeline->steps.push_back(std::move(step));
                 }
-                return left;
+                return pipeline;
             }
 
-            Value parse_object() {
+            NodePtr parse_object() {
                 consume(Token::T_LBRACE, "{");
-                ordered_json obj = ordered_json::object();
+                auto obj = std::make_unique<Node>(Node::N_OBJECT);
                 while (cur.type != Token::T_RBRACE) {
                     if (cur.type == Token::T_EOF) throw JZError("Unterminated object literal", cur.line, cur.col);
 
-                    std::string key;
+                    ObjectEntry entry;
 
                     // Handle dynamic key: $(...) or $(identifier)
                     if (cur.type == Token::T_IDENTIFIER && cur.text == "$") {
@@ -1297,34 +1463,25 @@ namespace jz {
                         if (nextTok.type == Token::T_LPAREN) {
                             // Parse $(expr) as key
                             cur = lex.next(); // first token after '('
-                            Value keyVal = parse_expr();
+                            entry.key_expr = parse_expr();
                             consume(Token::T_RPAREN, "')'");
-                            // Convert key value to string
-                            if (keyVal.j.is_string()) {
-                                key = keyVal.j.get<string>();
-                            } else if (!is_undefined(keyVal)) {
-                                key = keyVal.j.dump();
-                            } else {
-                                throw JZError("Object key expression evaluated to undefined", cur.line, cur.col);
-                            }
+                            entry.line = cur.line;
+                            entry.col = cur.col;
                         } else {
                             throw JZError("Expected '(' after '$' in object key", cur.line, cur.col);
                         }
                     }
                     // Static keys: string or identifier
-                    else if (cur.type == Token::T_STRING) {
-                        key = cur.text;
-                        cur = lex.next();
-                    } else if (cur.type == Token::T_IDENTIFIER) {
-                        key = cur.text;
+                    else if (cur.type == Token::T_STRING || cur.type == Token::T_IDENTIFIER) {
+                        entry.key = cur.text;
                         cur = lex.next();
                     } else {
                         throw JZError("Expected object key (identifier, string, or $(...))", cur.line, cur.col);
                     }
 
                     consume(Token::T_COLON, ":");
-                    Value v = parse_expr();
-                    obj[key] = v.j;
+                    entry.value = parse_expr();
+                    obj->entries.push_back(std::move(entry));
 
                     if (cur.type == Token::T_COMMA) {
                         match(Token::T_COMMA);
@@ -1332,121 +1489,103 @@ namespace jz {
                     }
                 }
                 consume(Token::T_RBRACE, "}");
-                return Value::from_json(std::move(obj));
+                return obj;
             }
 
-            Value parse_array() {
+            NodePtr parse_array() {
                 consume(Token::T_LBRACKET, "[");
-                ordered_json arr = ordered_json::array();
+                auto arr = std::make_unique<Node>(Node::N_ARRAY);
                 while (cur.type != Token::T_RBRACKET) {
                     if (cur.type == Token::T_EOF) throw JZError("Unterminated array literal", cur.line, cur.col);
-                    Value v = parse_expr();
-                    arr.push_back(v.j);
+                    arr->children.push_back(parse_expr());
                     if (cur.type == Token::T_COMMA) {
                         match(Token::T_COMMA);
                         if (cur.type == Token::T_RBRACKET) break;
                     }
                 }
                 consume(Token::T_RBRACKET, "]");
-                return Value::from_json(std::move(arr));
-            }
-
-            [[nodiscard]] Value interpolate_template(const std::string &raw) const {
-                return Value::from_json(interpolate_template(raw, data, metadata));
+                return arr;
             }
 
-            static ordered_json interpolate_template(const std::string &raw, const ordered_json &data,
-                                                     json &metadata) {
-                std::string out;
-                for (size_t i = 0; i < raw.size(); ++i) {
-                    if (raw[i] == '$' && i + 1 < raw.size() && raw[i + 1] == '(') {
-                        const size_t start = i + 2;
-                        int depth = 1;
-                        bool in_str = false;
-                        char delim = 0;
-                        bool esc = false;
-                        size_t j = start;
-                        while (j < raw.size()) {
-                            const char ch = raw[j++];
-                            if (in_str) {
-                                if (esc) {
-                                    esc = false;
-                                } else if (ch == '\\') {
-                                    esc = true;
-                                } else if (ch == delim) {
-                                    in_str = false;
-                                    delim = 0;
-                                }
-                                continue;
-                            }
-                            if (ch == '"' || ch == '\'') {
-                                in_str = true;
-                                delim = ch;
-                                continue;
-                            }
-                            if (ch == '(') {
-                                ++depth;
-                                continue;
-                            }
-                            if (ch == ')') { if (--depth == 0) break; }
-                        }
-                        if (depth != 0) throw JZError("Unterminated $(...) in template literal", 0, 0);
-                        std::string expr = raw.substr(start, j - start - 1);
-                        bool missing = false;
-                        ordered_json val = evaluate_expression(expr, data, metadata, missing);
-                        if (!missing && !is_undefined_sentinel(val)) {
-                            if (val.is_string()) out += val.get_ref<const std::string &>();
-                            else out += val.dump();
+            NodePtr parse_path(const string_view first, const bool dollar_path) {
+                auto path = std::make_unique<Node>(Node::N_PATH);
+                path->path.push_back(&symbols.intern(first));
+                while (cur.type == Token::T_DOT || cur.type == Token::T_LBRACKET) {
+                    if (cur.type == Token::T_DOT) {
+                        match(Token::T_DOT);
+                        if (cur.type != Token::T_IDENTIFIER)
+                            throw JZError(dollar_path
+                                              ? "Expected identifier after '.'"
+                                              : "Expected identifier after '.' in path", cur.line, cur.col);
+                        path->path.push_back(&symbols.intern(cur.text));
+                        cur = lex.next();
+                    } else if (dollar_path) {
+                        match(Token::T_LBRACKET);
+                        if (cur.type == Token::T_NUMBER || cur.type == Token::T_STRING || cur.type ==
+                            Token::T_IDENTIFIER) {
+                            path->path.push_back(&symbols.intern(cur.text));
+                            cur = lex.next();
+                        } else {
+                            throw JZError("Expected index or key inside []", cur.line, cur.col);
                         }
-                        i = j - 1; // advance
+                        consume(Token::T_RBRACKET, "]");
                     } else {
-                        out.push_back(raw[i]);
+                        match(Token::T_LBRACKET);
+                        if (cur.type == Token::T_NUMBER || cur.type == Token::T_STRING) {
+                            path->path.push_back(&symbols.intern(cur.text));
+                            cur = lex.next();
+                        } else
+                            throw JZError("Expected number or string inside [...] in path", cur.line, cur.col);
+                        consume(Token::T_RBRACKET, "']'");
                     }
                 }
-                return out;
+                return path;
             }
 
-            Value parse_primary() {
+            NodePtr parse_primary() {
                 switch (cur.type) {
                     case Token::T_DOT: {
                         // Allow '.' to represent the entire input object
                         match(Token::T_DOT);
-                        return Value::from_json(data);
+                        return make_node(Node::N_ROOT);
                     }
                     case Token::T_LPAREN: {
                         match(Token::T_LPAREN);
-                        Value v = parse_expr();
+                        NodePtr v = parse_expr();
                         consume(Token::T_RPAREN, "')'");
                         return v;
                     }
                     case Token::T_STRING: {
-                        string s = cur.text;
+                        auto literal = make_literal(ordered_json(string(cur.text)));
                         cur = lex.next();
-                        return Value::from_json(ordered_json(s));
+                        return literal;
                     }
                     case Token::T_NUMBER: {
-                        string n = cur.text;
+                        const string_view n = cur.text;
                         cur = lex.next();
-                        try {
-                            if (n.find_first_of(".eE") != string::npos) {
-                                double d = stod(n);
-                                return Value::from_json(ordered_json(d));
-                            }
-                            long long v = stoll(n);
-                            return Value::from_json(ordered_json(v));
-                        } catch (...) {
-                            return Value::from_json(ordered_json(n));
+                        // out of range: kept as the number text
+                        if (n.find_first_of(".eE") != string_view::npos) {
+                            double d;
+                            if (const auto [ptr, ec] = std::from_chars(n.data(), n.data() + n.size(), d);
+                                ec == std::errc())
+                                return make_literal(ordered_json(d));
+                        } else {
+                            long long ll;
+                            if (const auto [ptr, ec] = std::from_chars(n.data(), n.data() + n.size(), ll);
+                                ec == std::errc())
+                                return make_literal(ordered_json(ll));
                         }
+                        return make_literal(ordered_json(string(n)));
                     }
                     case Token::T_TRUE: cur = lex.next();
-                        return Value::from_json(ordered_json(true));
+                        return make_literal(ordered_json(true));
                     case Token::T_FALSE: cur = lex.next();
-                        return Value::from_json(ordered_json(false));
+                        return make_literal(ordered_json(false));
                     case Token::T_NULL: cur = lex.next();
-                        return Value::from_json(ordered_json(nullptr));
+                        return make_literal(ordered_json(nullptr));
                     case Token::T_UNDEFINED: {
                         cur = lex.next();
-                        return Value::from_json(undefined_sentinel());
+                        return make_node(Node::N_UNDEFINED);
                     }
                     case Token::T_IDENTIFIER: {
                         // Special case: '$(' ... ')' inside expressions should behave like a single $(...) expression
@@ -1457,351 +1596,2072 @@ namespace jz {
                             if (nextTok.type == Token::T_LPAREN) {
                                 // Consume '(' and parse inner expression, discarding the standalone '$' identifier
                                 cur = lex.next(); // first token after '('
-                                Value inner = parse_expr();
+                                NodePtr inner = parse_expr();
                                 consume(Token::T_RPAREN, "')'");
                                 return inner;
                             }
                             // Not a '$(' pattern: treat '$' as normal identifier path start
-                            cur = nextTok; // continue with path parsing using '$' as first part
-                            vector<string> parts;
-                            parts.push_back(dollarTok.text);
-                            while (cur.type == Token::T_DOT || cur.type == Token::T_LBRACKET) {
-                                if (cur.type == Token::T_DOT) {
-                                    match(Token::T_DOT);
-                                    if (cur.type != Token::T_IDENTIFIER)
-                                        throw JZError("Expected identifier after '.'", cur.line, cur.col);
-                                    parts.push_back(cur.text);
-                                    cur = lex.next();
-                                } else {
-                                    // bracket
-                                    match(Token::T_LBRACKET);
-                                    if (cur.type == Token::T_NUMBER || cur.type == Token::T_STRING || cur.type ==
-                                        Token::T_IDENTIFIER) {
-                                        parts.push_back(cur.text);
-                                        cur = lex.next();
-                                    } else {
-                                        throw JZError("Expected index or key inside []", cur.line, cur.col);
-                                    }
-                                    consume(Token::T_RBRACKET, "]");
-                                }
-                            }
-                            return resolve_path(parts);
+                            cur = nextTok;
+                            return parse_path(dollarTok.text, true);
                         }
-
-                        vector<string> parts;
-                        parts.push_back(cur.text);
+                        const string_view first = cur.text;
                         cur = lex.next();
-                        while (cur.type == Token::T_DOT || cur.type == Token::T_LBRACKET) {
-                            if (cur.type == Token::T_DOT) {
-                                match(Token::T_DOT);
-                                if (cur.type != Token::T_IDENTIFIER)
-                                    throw JZError("Expected identifier after '.' in path", cur.line, cur.col);
-                                parts.push_back(cur.text);
-                                cur = lex.next();
-                            } else {
-                                match(Token::T_LBRACKET);
-                                if (cur.type == Token::T_NUMBER) {
-                                    parts.push_back(cur.text);
-                                    cur = lex.next();
-                                } else if (cur.type == Token::T_STRING) {
-                                    parts.push_back(cur.text);
-                                    cur = lex.next();
-                                } else
-                                    throw JZError("Expected number or string inside [...] in path", cur.line, cur.col);
-                                consume(Token::T_RBRACKET, "']'");
-                            }
-                        }
-                        return resolve_path(parts);
+                        return parse_path(first, false);
                     }
                     case Token::T_LBRACE:
                         return parse_object();
                     case Token::T_LBRACKET:
                         return parse_array();
                     case Token::T_TEMPLATE: {
-                        const std::string raw = cur.text;
+                        auto tpl = std::make_unique<Node>(Node::N_TEMPLATE);
+                        tpl->parts = compile_template(cur.text, symbols);
                         cur = lex.next();
-                        return interpolate_template(raw);
+                        return tpl;
                     }
                     default:
                         throw JZError("Unexpected token in expression", cur.line, cur.col);
                 }
             }
 
-            [[nodiscard]] Value resolve_path(const vector<string> &parts) const {
-                const ordered_json *curj = &data;
-                for (const auto &p: parts) {
-                    bool is_index = !p.empty() && ranges::all_of(p, ::isdigit);
-                    if (curj->is_array() && is_index) {
-                        auto idx = static_cast<size_t>(stoull(p));
-                        if (idx >= curj->size()) return Value::missing_value();
-                        curj = &((*curj)[idx]);
-                    } else if (curj->is_object()) {
-                        auto it = curj->find(p);
-                        if (it == curj->end()) return Value::missing_value();
-                        curj = &(*it);
-                    } else return Value::missing_value();
-                }
-                if (is_undefined_sentinel(*curj)) return Value::from_json(*curj);
-                return Value::from_json(*curj);
+            // parse an expression string into a Node tree
+            static NodePtr parse(const string_view expr, Symbols &symbols) {
+                Parser p(expr, symbols);
+                return p.parse_expr();
             }
 
-            // evaluate expression helper
-            static ordered_json evaluate_expression(string_view expr, const ordered_json &data, json &metadata,
-                                                    bool &was_missing) {
-                Parser p(expr, data, metadata);
-                Value v = p.parse_expr();
-                was_missing = v.missing;
-                return v.j;
-            }
+            // compile an expression string into bytecode
+            static Program compile(string_view expr, Symbols &symbols);
         }; // end Parser
-    } // namespace eval
 
-    /* -------------------------
-       Template placeholder replacement
-       - supports $(expr) -> JSON insertion
-       - backtick strings: `...` where $(...) expressions inside are evaluated and resulting string inserted (then JSON-escaped)
-       - throws JZError with positions when unterminated templates/expressions found
-       ------------------------- */
+        /* compile_template:
+           - split the (already unescaped) content of a backtick template literal into literal text and $(...) parts
+        */
+        static vector<TemplatePart> compile_template(const string_view raw, Symbols &symbols) {
+            vector<TemplatePart> parts;
+            string text;
+            StructuralScanner::Cursor cursor(TEMPLATE_STRUCTURAL, raw);
+            for (size_t i = 0; i < raw.size(); ++i) {
+                // literal run up to the next structural byte
+                if (const size_t stop = cursor.next(i); stop > i) {
+                    text.append(raw.substr(i, stop - i));
+                    i = stop - 1;
+                    continue;
+                }
+                if (raw[i] == '$' && i + 1 < raw.size() && raw[i + 1] == '(') {
+                    const size_t start = i + 2;
+                    int depth = 1;
+                    bool in_str = false;
+                    char delim = 0;
+                    bool esc = false;
+                    size_t j = start;
+                    while (j < raw.size()) {
+                        if (!esc) j = cursor.next(j);
+                        if (j >= raw.size()) break;
+                        const char ch = raw[j++];
+                        if (in_str) {
+                            if (esc) {
+                                esc = false;
+                            } else if (ch == '\\') {
+                                esc = true;
+                            } else if (ch == delim) {
+                                in_str = false;
+                                delim = 0;
+                            }
+                            continue;
+                        }
+                        if (ch == '"' || ch == '\'') {
+                            in_str = true;
+                            delim = ch;
+                            continue;
+                        }
+                        if (ch == '(') {
+                            ++depth;
+                            continue;
+                        }
+                        if (ch == ')') { if (--depth == 0) break; }
+                    }
+                    if (depth != 0) throw JZError("Unterminated $(...) in template literal", 0, 0);
+                    if (!text.empty()) parts.push_back({std::move(text), nullptr});
+                    text.clear();
+                    parts.push_back({string(), Parser::parse(raw.substr(start, j - start - 1), symbols)});
+                    i = j - 1; // advance
+                } else {
+                    text.push_back(raw[i]);
+                }
+            }
+            if (!text.empty()) parts.push_back({std::move(text), nullptr});
+            return parts;
+        }
 
-    // helper to append value for template (if string => raw text, else JSON dump)
-    static void append_value_for_template(string &acc, const ordered_json &val) {
-        if (val.is_null()) return;
-        if (is_undefined_sentinel(val)) return;
-        if (val.is_string()) acc += val.get_ref<const string &>();
-        else acc += val.dump();
-    }
+        /* Program: an expression compiled into stack bytecode.
+           ?:, ||, && and ?? compile to jumps, so the branch that is not taken is never executed; evaluating a
+           Program does no lexing or parsing. Immutable once compiled (shareable between threads).
+        */
+        struct Instr {
+            enum Op : uint8_t {
+                PUSH_CONST, // arg: constant index
+                PUSH_UNDEFINED,
+                PUSH_ROOT,
+                PUSH_PATH, // arg: path index
+                NOT, EQ, NE, LT, GT, LTE, GTE,
+                JUMP, // arg: target
+                JUMP_IF_FALSE, // pop the condition, jump to arg when falsy
+                OR_ELSE, // keep the top and jump to arg when truthy, pop it otherwise
+                AND_THEN, // keep the top and jump to arg when falsy, pop it otherwise
+                NULLISH_ELSE, // keep the top and jump to arg when not nullish, pop it otherwise
+                NEW_ARRAY, ARRAY_PUSH,
+                NEW_OBJECT,
+                OBJECT_SET, // arg: key string index
+                OBJECT_SET_DYNAMIC, // key on the stack below the value; arg: key position index
+                NEW_STRING,
+                STRING_TEXT, // arg: text string index
+                STRING_APPEND, // append the popped value to the template string below it
+                TOOL, // pop options and input, push the tool output; arg: tool call index
+                MATCH // pop the pattern (unless constant) and the subject, push whether it matches; arg: match index
+            };
 
-    string Processor::replace_placeholders(string_view s, const ordered_json &data, json &metadata) {
-        // similar behavior as earlier implementation but using string_view and Scanner for pos tracking
-        string out;
-        out.reserve(s.size());
-        Scanner sc{s};
+            Op op;
+            uint32_t arg = 0;
+        };
 
-        bool in_string = false;
-        char delim = 0;
-        bool escape = false;
+        // tool step as executed by the TOOL instruction (options are compiled into the code before it, unless
+        // they are all literals)
+        struct ToolCall {
+            string name;
+            bool has_block = false;
+            string block;
+            size_t line = 1;
+            size_t col = 1;
+            std::optional<ordered_json> options{}; // constant options, built at compile time
+            ToolsManager::ToolHandle tool{}; // named tools, resolved at compile time when already registered
+            ToolsManager::PreparedOptions prepared{}; // constant options parsed for the resolved tool
+            // the block is compiled once with the expression and rendered for every context / loop item;
+            // a compile error is kept and reported where the block is rendered, as when it was parsed there
+            CompiledTemplate block_template{};
+            std::exception_ptr block_error{};
+
+            [[nodiscard]] const CompiledTemplate &compiled_block() const {
+                if (block_error) std::rethrow_exception(block_error);
+                return block_template;
+            }
+        };
 
-        while (!sc.eof()) {
-            char c = sc.next();
+        /* PathStep: one pre-resolved segment of a path expression.
+           Digit-only segments are parsed once and index arrays; every segment is also kept as the object key.
+        */
+        struct PathStep {
+            const string *key; // interned in the template's Symbols
+            bool numeric = false; // digit-only segment
+            bool overflow = false; // numeric but not representable as an index
+            size_t index = 0;
+        };
 
-            // handle backtick template: `...`
-            if (!in_string && c == '`') {
-                string acc;
-                bool esc = false;
-                auto start_pos = sc.position_prev();
-                while (!sc.eof()) {
-                    char ch = sc.next();
-                    if (esc) {
-                        acc.push_back(ch);
-                        esc = false;
-                        continue;
-                    }
-                    if (ch == '\\') {
-                        esc = true;
-                        continue;
-                    }
-                    if (ch == '`') break;
-                    /*if (ch == '$' && sc.peek() == '(') {
-                        sc.advance(); // skip '('
-                        // find matching ')' with nested parentheses and string awareness
-                        int depth = 1;
-                        bool ex_in_str = false;
-                        bool ex_esc = false;
-                        char ex_delim = 0;
-                        size_t expr_start_idx = sc.pos();
-                        size_t expr_start_line = sc.line, expr_start_col = sc.col;
-                        while (!sc.eof()) {
-                            char ec = sc.next();
-                            if (ex_in_str) {
-                                if (ex_esc) {
-                                    ex_esc = false;
-                                    continue;
-                                }
-                                if (ec == '\\') {
-                                    ex_esc = true;
-                                    continue;
-                                }
-                                if (ec == ex_delim) {
-                                    ex_in_str = false;
-                                    ex_delim = 0;
-                                    continue;
-                                }
-                                continue;
-                            } else {
-                                if (ec == '"' || ec == '\'') {
-                                    ex_in_str = true;
-                                    ex_delim = ec;
-                                    continue;
-                                }
-                                if (ec == '(') ++depth;
-                                else if (ec == ')') { if (--depth == 0) break; }
-                            }
-                        }
-                        if (sc.eof()) {
-                            throw JZError("Unterminated $(...) in template string", expr_start_line, expr_start_col);
-                        }
-                        size_t expr_end_idx = sc.pos() - 1;
-                        auto expr = string(sc.s.substr(expr_start_idx, expr_end_idx - expr_start_idx));
-                        bool missing = false;
-                        ordered_json val = eval::Parser::evaluate_expression(expr, data, metadata, missing);
-                        if (!missing && !val.is_null() && !is_undefined_sentinel(val))
-                            append_value_for_template(
-                                acc, val);
-                        continue;
-                    }*/
-                    acc.push_back(ch);
+        using PathAccessor = vector<PathStep>;
+
+        static PathAccessor compile_path(const vector<const string *> &parts) {
+            PathAccessor steps;
+            steps.reserve(parts.size());
+            for (const string *part: parts) {
+                const string &p = *part;
+                PathStep step{part};
+                step.numeric = !p.empty() && ranges::all_of(p, [](const char c) { return c >= '0' && c <= '9'; });
+                if (step.numeric) {
+                    const auto [ptr, ec] = std::from_chars(p.data(), p.data() + p.size(), step.index);
+                    step.overflow = ec != std::errc();
                 }
-                if (sc.eof()) {
-                    throw JZError("Unterminated template string (`...`)", start_pos.first, start_pos.second);
-                }
-                // produce JSON string literal from acc
-                out += eval::Parser::interpolate_template(acc, data, metadata).dump();
-                // out += ordered_json(acc).dump();
-                continue;
+                steps.push_back(std::move(step));
             }
+            return steps;
+        }
 
-            if (in_string) {
-                out.push_back(c);
-                if (escape) escape = false;
-                else {
-                    if (c == '\\') escape = true;
-                    else if (c == delim) {
-                        in_string = false;
-                        delim = 0;
-                    }
+        // =~ as executed by the MATCH instruction
+        struct MatchOp {
+            shared_ptr<const Regex> regex; // constant pattern (shared through the regex cache)
+            size_t line = 1;
+            size_t col = 1;
+        };
+
+        struct Program {
+            vector<Instr> code;
+            vector<ordered_json> constants;
+            vector<PathAccessor> paths;
+            vector<string> strings; // object keys, option names and template text
+            vector<ToolCall> tools;
+            vector<MatchOp> matches;
+            vector<pair<size_t, size_t>> key_positions; // for dynamic key errors
+            size_t max_stack = 0;
+
+            // approximate memory used (template cache budget)
+            [[nodiscard]] size_t memory_size() const noexcept {
+                size_t n = sizeof(Program) + code.size() * sizeof(Instr) +
+                           key_positions.size() * sizeof(pair<size_t, size_t>) + matches.size() * sizeof(MatchOp);
+                for (const auto &c: constants)
+                    n += sizeof(ordered_json) + (c.is_string() ? c.get_ref<const string &>().size() : 0);
+                for (const auto &path: paths) {
+                    n += sizeof(PathAccessor);
+                    n += path.size() * sizeof(PathStep);
                 }
-                continue;
+                for (const auto &str: strings) n += sizeof(string) + str.size();
+                for (const auto &tool: tools)
+                    n += sizeof(ToolCall) + tool.name.size() + tool.block.size() + tool.block_template.memory_size();
+                return n;
             }
+        };
 
-            if (c == '"' || c == '\'') {
-                in_string = true;
-                delim = c;
-                out.push_back(c);
-                continue;
+        /* Compiler: lowers a Node tree into a Program */
+        struct Compiler {
+            Program prog;
+            size_t depth = 0;
+
+            static Program compile(const Node &n) {
+                Compiler c;
+                c.emit_node(n);
+                return std::move(c.prog);
+            }
+
+            size_t emit(const Instr::Op op, const uint32_t arg = 0) {
+                prog.code.push_back({op, arg});
+                return prog.code.size() - 1;
             }
 
-            // if (c == '#' && sc.peek() == '{') {
-            //     auto [ln, col] = sc.position_prev();
-            //     throw JZError("Encountered '#{...}' directive which is not supported", ln, col);
-            // }
+            void push(const size_t n = 1) {
+                depth += n;
+                prog.max_stack = std::max(prog.max_stack, depth);
+            }
 
-            // handle $(expr) replacement
-            if (c == '$' && sc.peek() == '(') {
-                // remember start position for error reporting
-                auto start_pos = sc.position_prev();
-                sc.advance(); // skip '('
-                int depth = 1;
-                bool str_in = false;
-                bool str_esc = false;
-                char str_delim = 0;
-                size_t expr_start_idx = sc.pos();
-                size_t expr_start_line = sc.line, expr_start_col = sc.col;
-                while (!sc.eof()) {
-                    char ch = sc.next();
-                    if (str_in) {
-                        if (str_esc) {
-                            str_esc = false;
-                            continue;
+            void patch(const size_t at) { prog.code[at].arg = static_cast<uint32_t>(prog.code.size()); }
+
+            uint32_t add_string(string s) {
+                prog.strings.push_back(std::move(s));
+                return static_cast<uint32_t>(prog.strings.size() - 1);
+            }
+
+            void emit_binary(const Node &n, const Instr::Op op) {
+                emit_node(*n.children[0]);
+                emit_node(*n.children[1]);
+                emit(op);
+                --depth;
+            }
+
+            // left operand stays as the result when the jump is taken, otherwise the right operand replaces it
+            void emit_short_circuit(const Node &n, const Instr::Op op) {
+                emit_node(*n.children[0]);
+                const size_t jump = emit(op);
+                --depth;
+                emit_node(*n.children[1]);
+                patch(jump);
+            }
+
+            void emit_node(const Node &n) {
+                switch (n.kind) {
+                    case Node::N_LITERAL:
+                        prog.constants.push_back(n.value);
+                        emit(Instr::PUSH_CONST, static_cast<uint32_t>(prog.constants.size() - 1));
+                        push();
+                        return;
+                    case Node::N_UNDEFINED:
+                        emit(Instr::PUSH_UNDEFINED);
+                        push();
+                        return;
+                    case Node::N_ROOT:
+                        emit(Instr::PUSH_ROOT);
+                        push();
+                        return;
+                    case Node::N_PATH:
+                        prog.paths.push_back(compile_path(n.path));
+                        emit(Instr::PUSH_PATH, static_cast<uint32_t>(prog.paths.size() - 1));
+                        push();
+                        return;
+                    case Node::N_NOT:
+                        emit_node(*n.children[0]);
+                        emit(Instr::NOT);
+                        return;
+                    case Node::N_EQ: emit_binary(n, Instr::EQ);
+                        return;
+                    case Node::N_NE: emit_binary(n, Instr::NE);
+                        return;
+                    case Node::N_LT: emit_binary(n, Instr::LT);
+                        return;
+                    case Node::N_GT: emit_binary(n, Instr::GT);
+                        return;
+                    case Node::N_LTE: emit_binary(n, Instr::LTE);
+                        return;
+                    case Node::N_GTE: emit_binary(n, Instr::GTE);
+                        return;
+                    case Node::N_MATCH:
+                        prog.matches.push_back(MatchOp{n.regex, n.line, n.col});
+                        if (n.regex) {
+                            emit_node(*n.children[0]);
+                            emit(Instr::MATCH, static_cast<uint32_t>(prog.matches.size() - 1));
+                        } else {
+                            emit_binary(n, Instr::MATCH);
+                            prog.code.back().arg = static_cast<uint32_t>(prog.matches.size() - 1);
                         }
-                        if (ch == '\\') {
-                            str_esc = true;
-                            continue;
+                        return;
+                    case Node::N_OR: emit_short_circuit(n, Instr::OR_ELSE);
+                        return;
+                    case Node::N_AND: emit_short_circuit(n, Instr::AND_THEN);
+                        return;
+                    case Node::N_NULLISH: emit_short_circuit(n, Instr::NULLISH_ELSE);
+                        return;
+                    case Node::N_TERNARY: {
+                        emit_node(*n.children[0]);
+                        const size_t to_else = emit(Instr::JUMP_IF_FALSE);
+                        --depth;
+                        emit_node(*n.children[1]);
+                        const size_t to_end = emit(Instr::JUMP);
+                        --depth;
+                        patch(to_else);
+                        emit_node(*n.children[2]);
+                        patch(to_end);
+                        return;
+                    }
+                    case Node::N_OBJECT:
+                        emit(Instr::NEW_OBJECT);
+                        push();
+                        for (const auto &entry: n.entries) {
+                            if (entry.key_expr) {
+                                emit_node(*entry.key_expr);
+                                emit_node(*entry.value);
+                                prog.key_positions.emplace_back(entry.line, entry.col);
+                                emit(Instr::OBJECT_SET_DYNAMIC,
+                                     static_cast<uint32_t>(prog.key_positions.size() - 1));
+                                depth -= 2;
+                            } else {
+                                emit_node(*entry.value);
+                                emit(Instr::OBJECT_SET, add_string(entry.key));
+                                --depth;
+                            }
                         }
-                        if (ch == str_delim) {
-                            str_in = false;
-                            str_delim = 0;
+                        return;
+                    case Node::N_ARRAY:
+                        emit(Instr::NEW_ARRAY);
+                        push();
+                        for (const auto &el: n.children) {
+                            emit_node(*el);
+                            emit(Instr::ARRAY_PUSH);
+                            --depth;
                         }
-                    } else {
-                        if (ch == '"' || ch == '\'') {
-                            str_in = true;
-                            str_delim = ch;
-                            continue;
+                        return;
+                    case Node::N_TEMPLATE:
+                        emit(Instr::NEW_STRING);
+                        push();
+                        for (const auto &part: n.parts) {
+                            if (!part.expr) {
+                                emit(Instr::STRING_TEXT, add_string(part.text));
+                                continue;
+                            }
+                            emit_node(*part.expr);
+                            emit(Instr::STRING_APPEND);
+                            --depth;
                         }
-                        if (ch == '(') ++depth;
-                        else if (ch == ')') { if (--depth == 0) break; }
-                    }
-                }
-                if (sc.eof()) throw JZError("Unterminated $(...) placeholder", expr_start_line, expr_start_col);
-                size_t expr_end_idx = sc.pos() - 1;
-                auto expr = string(sc.s.substr(expr_start_idx, expr_end_idx - expr_start_idx));
-                bool missing = false;
-                ordered_json val = eval::Parser::evaluate_expression(expr, data, metadata, missing);
-                if (missing) out += undefined_sentinel().dump();
-                else {
-                    if (is_undefined_sentinel(val)) out += undefined_sentinel().dump();
-                    else out += val.dump();
+                        return;
+                    case Node::N_PIPELINE:
+                        emit_node(*n.children[0]);
+                        for (const auto &step: n.steps) {
+                            const bool constant = ranges::all_of(step.options, [](const auto &option) {
+                                return option.expr->kind == Node::N_LITERAL;
+                            });
+                            if (!constant) {
+                                emit(Instr::NEW_OBJECT);
+                                push();
+                                for (const auto &[optname, optexpr]: step.options) {
+                                    emit_node(*optexpr);
+                                    emit(Instr::OBJECT_SET, add_string(optname));
+                                    --depth;
+                                }
+                            }
+                            ToolCall &call = prog.tools.emplace_back(
+                                ToolCall{step.name, step.has_block, step.block, step.line, step.col});
+                            if (constant) {
+                                call.options = ordered_json::object();
+                                for (const auto &[optname, optexpr]: step.options)
+                                    (*call.options)[optname] = optexpr->value;
+                            }
+                            if (!call.name.empty() && call.name != "$") {
+                                call.tool = ToolsManager::instance().resolve(
+                                    call.name[0] == '$' ? call.name.substr(1) : call.name);
+                                if (call.tool && call.options) call.prepared = call.tool.prepare(*call.options);
+                            }
+                            try {
+                                call.block_template = Processor::compile(call.block);
+                            } catch (...) {
+                                call.block_error = std::current_exception();
+                            }
+                            emit(Instr::TOOL, static_cast<uint32_t>(prog.tools.size() - 1));
+                            if (!constant) --depth;
+                        }
+                        return;
                 }
-                continue;
+                throw JZError("Unexpected node in expression", 0, 0);
             }
+        };
 
-            out.push_back(c);
+        Program Parser::compile(const string_view expr, Symbols &symbols) {
+            return Compiler::compile(*parse(expr, symbols));
         }
 
-        return out;
-    }
+        // compile the (already unescaped) content of a backtick template literal; the result is always a string
+        static Program compile_template_program(const string_view raw, Symbols &symbols) {
+            Node tpl(Node::N_TEMPLATE);
+            tpl.parts = compile_template(raw, symbols);
+            return Compiler::compile(tpl);
+        }
 
-    /* remove_undefined_sentinels:
-       - remove object properties with the undefined sentinel
-       - filter out undefined sentinel elements from arrays
-    */
-    void Processor::remove_undefined_sentinels(ordered_json &j) {
-        if (j.is_object()) {
-            vector<string> to_erase;
-            for (auto it = j.begin(); it != j.end(); ++it) {
-                const string &key = it.key();
-                ordered_json &val = it.value();
-                if (is_undefined_sentinel(val)) to_erase.push_back(key);
-                else remove_undefined_sentinels(val);
-            }
-            for (const auto &k: to_erase) j.erase(k);
+        /* OperandStack: value stack of Evaluator::run.
+           Slots are constructed on push and destroyed on pop; storage is inline for the usual small
+           expressions and in the render arena only for deep ones.
+        */
+        class OperandStack {
+        public:
+            explicit OperandStack(const size_t capacity)
+                : _capacity(capacity),
+                  _base(capacity <= INLINE
+                            ? reinterpret_cast<Value *>(_inline)
+                            : static_cast<Value *>(_resource->allocate(capacity * sizeof(Value), alignof(Value)))) {
+            }
+
+            OperandStack(const OperandStack &) = delete;
+
+            OperandStack &operator=(const OperandStack &) = delete;
+
+            ~OperandStack() {
+                while (_size) pop();
+                if (_base != reinterpret_cast<Value *>(_inline))
+                    _resource->deallocate(_base, _capacity * sizeof(Value), alignof(Value));
+            }
+
+            void push(Value v) { new(_base + _size++) Value(std::move(v)); }
+            void pop() noexcept { _base[--_size].~Value(); }
+            // k-th value from the top
+            Value &top(const size_t k = 0) noexcept { return _base[_size - 1 - k]; }
+
+        private:
+            static constexpr size_t INLINE = 8;
+
+            alignas(Value) unsigned char _inline[INLINE * sizeof(Value)];
+            std::pmr::memory_resource *_resource = RenderArena::resource();
+            size_t _capacity;
+            Value *_base;
+            size_t _size = 0;
+        };
+
+        /* KeyIndex: member lookups in the render data
+           - ordered_json objects are vectors of members: find() compares every key; objects of at least
+             MIN_KEYS members get a hash index built on their first lookup and kept for the render
+           - only objects of the render data are indexed (they are neither modified nor freed while it runs);
+             the member order is untouched
+           - lookups run from several threads only while a parallel loop renders items of the data: they take
+             the lock then (see Sharing), otherwise the render's own thread is the only one using the index
+        */
+        class KeyIndex {
+        public:
+            static constexpr size_t MIN_KEYS = 32;
+
+            // lookups take the lock while it lives: set by the thread starting a parallel loop before its items
+            // are handed to the pool and cleared once they have all finished; a nested loop finds it set already
+            class Sharing {
+            public:
+                explicit Sharing(const KeyIndex *keys) noexcept : _keys(keys && !keys->_shared ? keys : nullptr) {
+                    if (_keys) _keys->_shared = true;
+                }
+
+                ~Sharing() {
+                    if (_keys) _keys->_shared = false;
+                }
+
+                Sharing(const Sharing &) = delete;
+
+                Sharing &operator=(const Sharing &) = delete;
+
+            private:
+                const KeyIndex *_keys;
+            };
+
+            // member `key` of `object`, nullptr when missing
+            [[nodiscard]] const ordered_json *find(const ordered_json &object, const string &key) const {
+                if (object.size() < MIN_KEYS) {
+                    const auto it = object.find(key);
+                    return it != object.end() ? &*it : nullptr;
+                }
+                const Members &members = index(object);
+                const auto it = members.find(key);
+                return it != members.end() ? it->second : nullptr;
+            }
+
+        private:
+            // keys are views of the object's own keys
+            using Members = unordered_map<string_view, const ordered_json *>;
+
+            [[nodiscard]] const Members &index(const ordered_json &object) const {
+                if (!_shared) {
+                    auto &members = _objects[&object];
+                    if (!members) members = build(object);
+                    return *members;
+                }
+                {
+                    shared_lock lock(_mutex);
+                    if (const auto it = _objects.find(&object); it != _objects.end()) return *it->second;
+                }
+                auto members = build(object);
+                unique_lock lock(_mutex);
+                return *_objects.try_emplace(&object, std::move(members)).first->second;
+            }
+
+            [[nodiscard]] static unique_ptr<const Members> build(const ordered_json &object) {
+                auto members = make_unique<Members>(object.size());
+                for (auto it = object.begin(); it != object.end(); ++it) members->emplace(it.key(), &*it);
+                return members;
+            }
+
+            mutable bool _shared = false; // a parallel loop is running over the data (see Sharing)
+            mutable shared_mutex _mutex;
+            mutable unordered_map<const ordered_json *, unique_ptr<const Members>> _objects;
+        };
+
+        /* Scope:
+           - the data seen by a tool block: index/key bindings and a merged item layered over the parent
+             data, which is never copied ($ loops render one block per array element); scopes chain for
+             nested loops, the root scope is the render data
+           - reads give the values of the legacy construction: a copy of the parent data, bindings set with
+             operator[] (index first, then key), item merged with merge_patch
+        */
+        struct Scope {
+            const Scope *parent = nullptr; // nullptr: root scope
+            const ordered_json *data = nullptr; // root scope data
+            const KeyIndex *keys = nullptr; // root scope: member lookups in data (linear when not set)
+            string_view index_name{}; // index binding, when not empty
+            ordered_json index{};
+            string_view key_name{}; // key binding, when key_value is set
+            const ordered_json *key_value = nullptr;
+            const ordered_json *patch = nullptr; // merged item
+            const LazyDocument *lazy = nullptr; // root scope data read on demand (instead of data)
+
+            [[nodiscard]] bool has_bindings() const noexcept { return !index_name.empty() || key_value; }
+
+            // type of the whole scope value
+            [[nodiscard]] ordered_json::value_t kind() const noexcept {
+                if (!parent) return lazy ? lazy->type(lazy->root()) : data->type();
+                if (patch) return patch->is_object() ? ordered_json::value_t::object : patch->type();
+                if (has_bindings()) return ordered_json::value_t::object;
+                return parent->kind();
+            }
+
+            // bindings can only be set over an object (or null) value: fail with the legacy copy's type error
+            void check_bindable() const {
+                const auto k = kind();
+                if (k == ordered_json::value_t::object || k == ordered_json::value_t::null) return;
+                ordered_json probe(k);
+                probe[string()] = nullptr;
+            }
+
+            // the whole scope value (as the legacy copy); only for `.` and nested non-object parents
+            [[nodiscard]] ordered_json materialize() const {
+                if (!parent) return lazy ? lazy->materialize(lazy->root()) : *data;
+                ordered_json v = parent->materialize();
+                if (!index_name.empty()) v[string(index_name)] = index;
+                if (key_value) v[string(key_name)] = *key_value;
+                if (patch) v.merge_patch(*patch);
+                return v;
+            }
+        };
+
+        // member `key` of `object`, through the key index of `root` when there is one; nullptr when missing
+        static const ordered_json *find_member(const Scope *root, const ordered_json &object, const string &key) {
+            if (root && root->keys) return root->keys->find(object, key);
+            const auto it = object.find(key);
+            return it != object.end() ? &*it : nullptr;
+        }
+
+        // root scope of a render: the data and its key index
+        struct DataRoot {
+            KeyIndex keys;
+            Scope scope;
+
+            explicit DataRoot(const ordered_json &data) : scope{nullptr, &data, &keys} {
+            }
+
+            DataRoot(const DataRoot &) = delete;
+
+            DataRoot &operator=(const DataRoot &) = delete;
+        };
+
+        /* Layer: one contribution to a value read through scopes, bottom to top:
+           - PLAIN replaces what is below, PATCH is applied with merge_patch, BIND is the bindings of a scope
+           - LAZY is PLAIN for a value of a lazy root document (read on demand)
+        */
+        struct Layer {
+            enum Kind { PLAIN, PATCH, BIND, LAZY };
+
+            Kind kind;
+            const ordered_json *node; // PLAIN, PATCH
+            const Scope *scope; // BIND; LAZY: the root scope holding the document; PLAIN: the root scope when node
+                                // is part of its data (members are looked up through its key index)
+            LazyDocument::Node lazy_node{}; // LAZY
+        };
+
+        // scratch of a single lookup: in the render arena
+        using Layers = std::pmr::vector<Layer>;
+
+        static void scope_layers(const Scope &scope, Layers &out) {
+            if (!scope.parent) {
+                if (scope.lazy) out.push_back({Layer::LAZY, nullptr, &scope, scope.lazy->root()});
+                else out.push_back({Layer::PLAIN, scope.data, &scope});
+                return;
+            }
+            scope_layers(*scope.parent, out);
+            if (scope.has_bindings()) out.push_back({Layer::BIND, nullptr, &scope});
+            if (scope.patch) out.push_back({Layer::PATCH, scope.patch, nullptr});
+        }
+
+        // type of the value made of the first n layers (null when there are none)
+        static ordered_json::value_t layers_kind(const Layers &layers, const size_t n) noexcept {
+            if (n == 0) return ordered_json::value_t::null;
+            const Layer &top = layers[n - 1];
+            if (top.kind == Layer::BIND) return ordered_json::value_t::object;
+            if (top.kind == Layer::LAZY) return top.scope->lazy->type(top.lazy_node);
+            if (top.kind == Layer::PATCH && top.node->is_object()) return ordered_json::value_t::object;
+            return top.node->type();
+        }
+
+        // layers of member `key` of an object value; empty when the member does not exist
+        static void layers_member(const Layers &layers, const string &key, Layers &out) {
+            out.clear();
+            for (size_t i = layers.size(); i-- > 0;) {
+                const Layer &l = layers[i];
+                if (l.kind == Layer::BIND) {
+                    // key is set after index: it wins when both have the same name
+                    if (l.scope->key_value && key == l.scope->key_name) {
+                        out.push_back({Layer::PLAIN, l.scope->key_value, nullptr});
+                        break;
+                    }
+                    if (!l.scope->index_name.empty() && key == l.scope->index_name) {
+                        out.push_back({Layer::PLAIN, &l.scope->index, nullptr});
+                        break;
+                    }
+                } else if (l.kind == Layer::PATCH && l.node->is_object()) {
+                    const auto it = l.node->find(key);
+                    if (it != l.node->end()) {
+                        if (it->is_null()) break; // merge_patch removes the member
+                        out.push_back({Layer::PATCH, &*it, nullptr});
+                        if (!it->is_object()) break; // replaces the member below
+                    }
+                } else if (l.kind == Layer::LAZY) {
+                    const LazyDocument &doc = *l.scope->lazy;
+                    if (doc.type(l.lazy_node) == ordered_json::value_t::object) {
+                        if (const auto member = doc.member(l.lazy_node, key))
+                            out.push_back({Layer::LAZY, nullptr, l.scope, *member});
+                    }
+                    break;
+                } else {
+                    if (l.node->is_object()) {
+                        if (const ordered_json *member = find_member(l.scope, *l.node, key))
+                            out.push_back({Layer::PLAIN, member, l.scope});
+                    }
+                    break;
+                }
+                // bindings and object patches only merge with an object below
+                if (layers_kind(layers, i) != ordered_json::value_t::object) break;
+            }
+            std::reverse(out.begin(), out.end());
+        }
+
+        static ordered_json materialize_layers(const Layers &layers) {
+            ordered_json v;
+            for (const Layer &l: layers) {
+                switch (l.kind) {
+                    case Layer::PLAIN:
+                        v = *l.node;
+                        break;
+                    case Layer::LAZY:
+                        v = l.scope->lazy->materialize(l.lazy_node);
+                        break;
+                    case Layer::PATCH:
+                        v.merge_patch(*l.node);
+                        break;
+                    case Layer::BIND:
+                        if (!l.scope->index_name.empty()) v[string(l.scope->index_name)] = l.scope->index;
+                        if (l.scope->key_value) v[string(l.scope->key_name)] = *l.scope->key_value;
+                        break;
+                }
+            }
+            return v;
+        }
+
+        // Processor::set_parallel_loops: minimum item count of a parallel tool loop, 0 when off
+        static atomic<size_t> parallel_min_items{0};
+
+        // whether a tool loop over `count` items runs in parallel: the loop option wins over the policy
+        static bool parallel_loop(const ordered_json &options, const char *option, const size_t count) {
+            if (options.contains(option)) return options[option].get<bool>() && count > 1;
+            const size_t min_items = parallel_min_items.load(memory_order_relaxed);
+            return min_items != 0 && count >= min_items;
+        }
+
+        // metadata written by one item of a parallel loop (rendered on an empty metadata), merged in item order:
+        // objects member by member, arrays appended to, other values replaced
+        static void merge_item_metadata(json &metadata, json &&item_metadata) {
+            if (metadata.is_object() && item_metadata.is_object()) {
+                for (auto it = item_metadata.begin(); it != item_metadata.end(); ++it)
+                    merge_item_metadata(metadata[it.key()], std::move(*it));
+            } else if (metadata.is_array() && item_metadata.is_array()) {
+                for (auto &element: item_metadata) metadata.push_back(std::move(element));
+            } else {
+                metadata = std::move(item_metadata);
+            }
+        }
+
+        /* Evaluator: run compiled Programs against the input data (through the scope chain) */
+        struct Evaluator {
+            const Scope &scope;
+            json &metadata;
+
+            Value run(const Program &prog) const {
+                OperandStack stack(prog.max_stack);
+                const Instr *code = prog.code.data();
+                const size_t size = prog.code.size();
+                size_t pc = 0;
+                while (pc < size) {
+                    const Instr &in = code[pc++];
+                    switch (in.op) {
+                        case Instr::PUSH_CONST:
+                            stack.push(Value::borrow(prog.constants[in.arg]));
+                            break;
+                        case Instr::PUSH_UNDEFINED:
+                            stack.push(Value::undefined_value());
+                            break;
+                        case Instr::PUSH_ROOT:
+                            if (!scope.parent)
+                                stack.push(Value::borrow(scope.lazy
+                                                             ? scope.lazy->materialize(scope.lazy->root())
+                                                             : *scope.data));
+                            else stack.push(Value::from_json(scope.materialize()));
+                            break;
+                        case Instr::PUSH_PATH:
+                            stack.push(resolve_path(prog.paths[in.arg]));
+                            break;
+                        case Instr::NOT:
+                            stack.top() = Value::from_json(ordered_json(!is_truthy(stack.top())));
+                            break;
+                        case Instr::EQ:
+                        case Instr::NE: {
+                            const bool res = eq_values(stack.top(1), stack.top());
+                            stack.pop();
+                            stack.top() = Value::from_json(ordered_json(in.op == Instr::EQ ? res : !res));
+                            break;
+                        }
+                        case Instr::MATCH: {
+                            const MatchOp &op = prog.matches[in.arg];
+                            shared_ptr<const Regex> dynamic;
+                            if (!op.regex) {
+                                // pattern from the data, through the cache (not a string: no match)
+                                const Value &pattern = stack.top();
+                                if (!is_undefined(pattern) && pattern.j().is_string()) {
+                                    try {
+                                        dynamic = RegexCache::instance().get(pattern.j().get_ref<const string &>());
+                                    } catch (const exception &e) {
+                                        throw JZError(std::format("Invalid regular expression: {}", e.what()),
+                                                      op.line, op.col);
+                                    }
+                                }
+                                stack.pop();
+                            }
+                            const Regex *regex = op.regex ? op.regex.get() : dynamic.get();
+                            const Value &subject = stack.top();
+                            const bool res = regex && !is_undefined(subject) && subject.j().is_string() &&
+                                             regex->search(subject.j().get_ref<const string &>());
+                            stack.top() = Value::from_json(ordered_json(res));
+                            break;
+                        }
+                        case Instr::LT:
+                        case Instr::GT:
+                        case Instr::LTE:
+                        case Instr::GTE: {
+                            const char opcode = (in.op == Instr::LT)
+                                                    ? '<'
+                                                    : (in.op == Instr::GT)
+                                                          ? '>'
+                                                          : (in.op == Instr::LTE)
+                                                                ? 'l'
+                                                                : 'g';
+                            auto cmp = relational_compare(stack.top(1), stack.top(), opcode);
+                            stack.pop();
+                            stack.top() = Value::from_json(ordered_json(cmp.has_value() ? cmp.value() : false));
+                            break;
+                        }
+                        case Instr::JUMP:
+                            pc = in.arg;
+                            break;
+                        case Instr::JUMP_IF_FALSE: {
+                            const bool cond = is_truthy(stack.top());
+                            stack.pop();
+                            if (!cond) pc = in.arg;
+                            break;
+                        }
+                        case Instr::OR_ELSE:
+                            if (is_truthy(stack.top())) pc = in.arg;
+                            else stack.pop();
+                            break;
+                        case Instr::AND_THEN:
+                            if (!is_truthy(stack.top())) pc = in.arg;
+                            else stack.pop();
+                            break;
+                        case Instr::NULLISH_ELSE:
+                            if (!is_nullish(stack.top())) pc = in.arg;
+                            else stack.pop();
+                            break;
+                        case Instr::NEW_ARRAY:
+                            stack.push(Value::from_json(ordered_json::array()));
+                            break;
+                        case Instr::ARRAY_PUSH: {
+                            // undefined elements are left out (a missing path becomes null)
+                            if (stack.top().undefined) {
+                                stack.pop();
+                                break;
+                            }
+                            ordered_json el = std::move(stack.top()).take();
+                            stack.pop();
+                            stack.top().own.push_back(std::move(el));
+                            break;
+                        }
+                        case Instr::NEW_OBJECT:
+                            stack.push(Value::from_json(ordered_json::object()));
+                            break;
+                        case Instr::OBJECT_SET: {
+                            // an undefined member is left out (and removes an earlier duplicate key)
+                            if (stack.top().undefined) {
+                                stack.pop();
+                                stack.top().own.erase(prog.strings[in.arg]);
+                                break;
+                            }
+                            ordered_json val = std::move(stack.top()).take();
+                            stack.pop();
+                            stack.top().own[prog.strings[in.arg]] = std::move(val);
+                            break;
+                        }
+                        case Instr::OBJECT_SET_DYNAMIC: {
+                            const bool undefined = stack.top().undefined;
+                            ordered_json val = std::move(stack.top()).take();
+                            stack.pop();
+                            // Convert key value to string
+                            const Value &keyVal = stack.top();
+                            string key;
+                            if (keyVal.j().is_string()) {
+                                key = keyVal.j().get<string>();
+                            } else if (!is_undefined(keyVal)) {
+                                key = keyVal.j().dump();
+                            } else {
+                                const auto [line, col] = prog.key_positions[in.arg];
+                                throw JZError("Object key expression evaluated to undefined", line, col);
+                            }
+                            stack.pop();
+                            if (undefined) stack.top().own.erase(key);
+                            else stack.top().own[key] = std::move(val);
+                            break;
+                        }
+                        case Instr::NEW_STRING:
+                            stack.push(Value::from_json(ordered_json(string())));
+                            break;
+                        case Instr::STRING_TEXT:
+                            stack.top().own.get_ref<string &>() += prog.strings[in.arg];
+                            break;
+                        case Instr::STRING_APPEND: {
+                            // strings are inserted raw, other values as JSON, undefined as nothing
+                            const Value v = std::move(stack.top());
+                            stack.pop();
+                            if (!is_undefined(v)) {
+                                string &out = stack.top().own.get_ref<string &>();
+                                if (v.j().is_string()) out += v.j().get_ref<const string &>();
+                                else out += v.j().dump();
+                            }
+                            break;
+                        }
+                        case Instr::TOOL: {
+                            const ToolCall &call = prog.tools[in.arg];
+                            if (call.options) {
+                                stack.top() = run_tool(call, std::move(stack.top()), *call.options);
+                                break;
+                            }
+                            const ordered_json options = std::move(stack.top()).take();
+                            stack.pop();
+                            stack.top() = run_tool(call, std::move(stack.top()), options);
+                            break;
+                        }
+                    }
+                }
+                return std::move(stack.top());
+            }
+
+            // tool loop: each item layered over `parent` with the index/key bindings (names may be empty),
+            // or the item alone as the data when there is no parent
+            struct Loop {
+                const Scope *parent;
+                string_view index_name;
+                string_view key_name;
+            };
+
+            static std::optional<ordered_json> render_loop_item(const ToolCall &step, const Loop &loop,
+                                                                const size_t idx, const ordered_json &item,
+                                                                json &item_metadata) {
+                // not render_optional: on a pool thread, it would report that thread's arena into the metadata
+                if (!loop.parent) return step.compiled_block().render_scoped(DataRoot(item).scope, item_metadata);
+                Scope item_scope{loop.parent};
+                item_scope.index_name = loop.index_name;
+                if (!loop.index_name.empty()) item_scope.index = idx;
+                if (!loop.key_name.empty()) {
+                    item_scope.key_name = loop.key_name;
+                    item_scope.key_value = &item;
+                } else
+                    item_scope.patch = &item;
+                return step.compiled_block().render_scoped(item_scope, item_metadata);
+            }
+
+            // render the block once per item, in item order (undefined results are left out); in parallel, items
+            // run on the shared pool, each on its own empty metadata, merged in item order onto the loop's metadata
+            // up to the first failing item, whose error is rethrown
+            ordered_json render_loop(const ToolCall &step, const Loop &loop, const ordered_json &items,
+                                     const bool parallel) const {
+                ordered_json out;
+                if (items.empty()) return out;
+                out = ordered_json::array();
+                const size_t count = items.size();
+                if (!parallel) {
+                    for (size_t idx = 0; idx < count; ++idx)
+                        if (auto rendered = render_loop_item(step, loop, idx, items[idx], metadata))
+                            out.push_back(std::move(*rendered));
+                    return out;
+                }
+
+                std::pmr::memory_resource *arena = RenderArena::resource();
+                std::pmr::vector<std::optional<ordered_json>> results(count, arena);
+                const json empty = metadata.is_object() || metadata.is_null() ? json::object() : json();
+                std::pmr::vector<json> item_metadata(count, empty, arena);
+                std::pmr::vector<exception_ptr> errors(count, arena);
+                // the items read the data of the loop's root scope from the pool threads
+                const Scope *root = loop.parent;
+                while (root && root->parent) root = root->parent;
+                {
+                    const KeyIndex::Sharing sharing(root ? root->keys : nullptr);
+                    ThreadPool::shared().parallel_for(count, [&](const size_t idx) {
+                        try {
+                            results[idx] = render_loop_item(step, loop, idx, items[idx], item_metadata[idx]);
+                        } catch (...) {
+                            errors[idx] = current_exception();
+                        }
+                    });
+                }
+                for (size_t idx = 0; idx < count; ++idx) {
+                    if (item_metadata[idx] != empty) merge_item_metadata(metadata, std::move(item_metadata[idx]));
+                    if (errors[idx]) rethrow_exception(errors[idx]);
+                    if (results[idx]) out.push_back(std::move(*results[idx]));
+                }
+                return out;
+            }
+
+            // Pipeline step: run tool only if input not undefined
+            Value run_tool(const ToolCall &step, Value left, const ordered_json &options) const {
+                const string &toolname = step.name;
+
+                ordered_json ctx = ordered_json::object();
+                bool ctx_undefined = false; // the context block rendered as undefined (ctx stays empty)
+                const auto render_ctx = [&](const Scope &ctx_scope) {
+                    auto rendered = step.compiled_block().render_scoped(ctx_scope, metadata);
+                    if (rendered) ctx = std::move(*rendered);
+                    else ctx_undefined = true;
+                };
+                if (step.has_block) {
+                    try {
+                        // parse context JSON from the raw block
+                        if (!toolname.empty() && toolname[0] == '$') {
+                            // modifier '$' tools: merge input data into context
+                            if (!left.j().is_null()) {
+                                // input data can be merged into a specific context key or at top level
+                                if (options.contains("$key")) {
+                                    const string key = options["$key"].get<string>();
+                                    scope.check_bindable();
+                                    Scope ctx_scope{&scope};
+                                    ctx_scope.key_name = key;
+                                    ctx_scope.key_value = &left.j();
+                                    // parse merged context JSON from raw_block
+                                    render_ctx(ctx_scope);
+                                } else if (!left.j().is_array()) {
+                                    // if input data are not an array and not empty, merge at top level
+                                    // (array can be merged only into a specific key)
+                                    if (!left.j().empty()) {
+                                        Scope ctx_scope{&scope};
+                                        ctx_scope.patch = &left.j();
+                                        // parse merged context JSON from raw_block
+                                        render_ctx(ctx_scope);
+                                    } else {
+                                        // parse context JSON from raw_block
+                                        render_ctx(scope);
+                                    }
+                                }
+                            }
+                        } else if (!toolname.empty()) {
+                            // parse merged context JSON from raw_block only if the tool is not anonymous
+                            render_ctx(scope);
+                        }
+                    } catch (const JZError &e) {
+                        throw JZError(toolname, e, step.line);
+                    } catch (const exception &e) {
+                        throw JZError(std::format("Tool '{}' error parsing context: [{}]", toolname, e.what()),
+                                      step.line, step.col);
+                    }
+                }
+
+                if (is_undefined(left)) {
+                    // keep undefined; skip calling the tool
+                    return left;
+                }
+
+                ordered_json out_val;
+                try {
+                    if (toolname == "$") {
+                        // anonymous tool: context was not processed beforehand; use context instruction to process input
+                        // the '$' modifier indicates that global context is available
+                        // '$loop' option tells to the anonymous tool if array input must be processed as items (default) or as a whole
+                        const auto _loop = options.contains("$loop")
+                                               ? options["$loop"].get<bool>()
+                                               : true;
+                        if (_loop && left.j().is_array()) {
+                            // put each array item into '$key' if given
+                            const auto _key = options.contains("$key")
+                                                  ? options["$key"].get<string>()
+                                                  : string();
+                            // put current index into each item if '$index' option is given
+                            const auto _idx = options.contains("$index")
+                                                  ? options["$index"].get<string>()
+                                                  : string();
+                            // special '$' tool: process each array item separately (undefined results are left out)
+                            // each item is layered over the global data, which is not copied
+                            if (!left.j().empty() && (!_idx.empty() || !_key.empty())) scope.check_bindable();
+                            out_val = render_loop(step, Loop{&scope, _idx, _key}, left.j(),
+                                                  parallel_loop(options, "$parallel", left.j().size()));
+                        } else {
+                            if (ctx_undefined) return Value::undefined_value();
+                            out_val = std::move(ctx);
+                        }
+                    } else if (toolname.empty()) {
+                        // anonymous tool: context was not processed beforehand; use context instruction to process input
+                        // please note that global context is not available
+                        // 'loop' option tells to the anonymous tool if array input must be processed as items (default) or as a whole
+                        const auto _loop = options.contains("loop")
+                                               ? options["loop"].get<bool>()
+                                               : true;
+                        if (_loop && left.j().is_array()) {
+                            // put each array item into '$key' if given
+                            const auto _key = options.contains("key")
+                                                  ? options["key"].get<string>()
+                                                  : string();
+                            // put current index into each item if 'index' option is given
+                            const auto _idx = options.contains("index")
+                                                  ? options["index"].get<string>()
+                                                  : string();
+                            // process each array item separately (undefined results are left out)
+                            // bindings are layered over empty data, an item without bindings is the data itself
+                            static const ordered_json no_data;
+                            const Scope empty_scope{nullptr, &no_data};
+                            out_val = render_loop(step,
+                                                  Loop{_idx.empty() && _key.empty() ? nullptr : &empty_scope, _idx,
+                                                       _key}, left.j(),
+                                                  parallel_loop(options, "parallel", left.j().size()));
+                        } else {
+                            auto rendered = step.compiled_block().render_optional(left.j(), metadata);
+                            if (!rendered) return Value::undefined_value();
+                            out_val = std::move(*rendered);
+                        }
+                    } else {
+                        // resolved handle: no registry lookup; by name for tools registered after compilation
+                        // an owned input (e.g. the previous step's result) is given up to the tool
+                        out_val = step.tool
+                                      ? left.ref
+                                            ? step.tool(left.j(), options, step.prepared, ctx, metadata)
+                                            : step.tool(std::move(left.own), options, step.prepared, ctx, metadata)
+                                      : ToolsManager::instance().run_tool(
+                                          toolname[0] == '$' ? toolname.substr(1) : toolname, left.j(), options, ctx,
+                                          metadata);
+                        // tools rendering through the public API (e.g. include) return undefined as the sentinel;
+                        // the output is not walked: they leave undefined items out of what they build
+                        if (is_undefined_sentinel(out_val)) return Value::undefined_value();
+                    }
+                } catch (const JZError &e) {
+                    throw JZError(toolname, e, step.line);
+                } catch (const std::exception &e) {
+                    throw JZError(std::format("Tool '{}' failed: {}", toolname, e.what()), step.line, step.col);
+                }
+                return Value::from_json(std::move(out_val));
+            }
+
+            [[nodiscard]] Value resolve_path(const PathAccessor &steps) const {
+                if (scope.parent) return resolve_scoped_path(steps);
+                if (scope.lazy) return resolve_lazy_path(*scope.lazy, steps);
+                const ordered_json *curj = scope.data;
+                for (const auto &step: steps) {
+                    if (curj->is_array() && step.numeric) {
+                        if (step.overflow) throw std::out_of_range("stoull");
+                        if (step.index >= curj->size()) return Value::missing_value();
+                        curj = &((*curj)[step.index]);
+                    } else if (curj->is_object()) {
+                        curj = find_member(&scope, *curj, *step.key);
+                        if (!curj) return Value::missing_value();
+                    } else return Value::missing_value();
+                }
+                return Value::borrow(*curj);
+            }
+
+            // resolve_path through the scope layers: members are looked up from the top layer down
+            [[nodiscard]] Value resolve_scoped_path(const PathAccessor &steps) const {
+                Layers cur(RenderArena::resource()), next(RenderArena::resource());
+                scope_layers(scope, cur);
+                for (const auto &step: steps) {
+                    const auto kind = layers_kind(cur, cur.size());
+                    if (kind == ordered_json::value_t::array && step.numeric) {
+                        if (step.overflow) throw std::out_of_range("stoull");
+                        const Layer &top = cur.back();
+                        if (top.kind == Layer::LAZY) {
+                            const auto element = top.scope->lazy->element(top.lazy_node, step.index);
+                            if (!element) return Value::missing_value();
+                            cur.assign(1, {Layer::LAZY, nullptr, top.scope, *element});
+                            continue;
+                        }
+                        const ordered_json &arr = *top.node;
+                        if (step.index >= arr.size()) return Value::missing_value();
+                        cur.assign(1, {Layer::PLAIN, &arr[step.index], top.scope});
+                    } else if (kind == ordered_json::value_t::object) {
+                        layers_member(cur, *step.key, next);
+                        if (next.empty()) return Value::missing_value();
+                        cur.swap(next);
+                    } else return Value::missing_value();
+                }
+                const Layer &top = cur.back();
+                if (top.kind == Layer::LAZY) return Value::borrow(top.scope->lazy->materialize(top.lazy_node));
+                if (top.kind != Layer::BIND && (top.kind == Layer::PLAIN || !top.node->is_object()))
+                    return Value::borrow(*top.node);
+                return Value::from_json(materialize_layers(cur));
+            }
+
+            // resolve_path at a lazy root: walks the document without parsing it, then materializes the value
+            [[nodiscard]] static Value resolve_lazy_path(const LazyDocument &doc, const PathAccessor &steps) {
+                LazyDocument::Node cur = doc.root();
+                for (const auto &step: steps) {
+                    const auto kind = doc.type(cur);
+                    std::optional<LazyDocument::Node> next;
+                    if (kind == ordered_json::value_t::array && step.numeric) {
+                        if (step.overflow) throw std::out_of_range("stoull");
+                        next = doc.element(cur, step.index);
+                    } else if (kind == ordered_json::value_t::object) {
+                        next = doc.member(cur, *step.key);
+                    }
+                    if (!next) return Value::missing_value();
+                    cur = *next;
+                }
+                return Value::borrow(doc.materialize(cur));
+            }
+        }; // end Evaluator
+    } // namespace eval
+
+    /* -------------------------
+       Template placeholder replacement
+       - supports $(expr) -> JSON insertion
+       - backtick strings: `...` where $(...) expressions inside are evaluated and resulting string inserted (then JSON-escaped)
+       - throws JZError with positions when unterminated templates/expressions found
+       The template is split once into segments (compile_segments); rendering only evaluates the compiled parts.
+       ------------------------- */
+
+    struct Segment {
+        enum Kind { S_TEXT, S_PLACEHOLDER, S_TEMPLATE };
+
+        Kind kind;
+        string text; // S_TEXT
+        eval::Program program; // S_PLACEHOLDER: the expression, S_TEMPLATE: the interpolated string
+    };
+
+    // path keys are interned into `symbols`, which must outlive the segments
+    static vector<Segment> compile_segments(const string_view s, eval::Symbols &symbols) {
+        vector<Segment> segments;
+        string text;
+        text.reserve(s.size());
+        Scanner sc{s};
+        StructuralScanner::Cursor cursor(TEMPLATE_STRUCTURAL, s);
+
+        bool in_string = false;
+        char delim = 0;
+        bool escape = false;
+
+        auto flush_text = [&]() {
+            if (text.empty()) return;
+            segments.push_back({Segment::S_TEXT, std::move(text), {}});
+            text.clear();
+        };
+
+        while (!sc.eof()) {
+            // copy the literal run up to the next structural byte in one step
+            if (!escape) {
+                if (const size_t stop = cursor.next(sc.pos()); stop > sc.pos()) {
+                    text.append(s.substr(sc.pos(), stop - sc.pos()));
+                    sc.skip_to(stop);
+                    continue;
+                }
+            }
+            char c = sc.next();
+
+            // handle backtick template: `...`
+            if (!in_string && c == '`') {
+                string acc;
+                bool esc = false;
+                bool closed = false;
+                auto start_pos = sc.position_prev();
+                while (!sc.eof()) {
+                    if (!esc) {
+                        if (const size_t stop = cursor.next(sc.pos()); stop > sc.pos()) {
+                            acc.append(s.substr(sc.pos(), stop - sc.pos()));
+                            sc.skip_to(stop);
+                            continue;
+                        }
+                    }
+                    char ch = sc.next();
+                    if (esc) {
+                        acc.push_back(ch);
+                        esc = false;
+                        continue;
+                    }
+                    if (ch == '\\') {
+                        esc = true;
+                        continue;
+                    }
+                    if (ch == '`') {
+                        closed = true;
+                        break;
+                    }
+                    acc.push_back(ch);
+                }
+                if (!closed) {
+                    throw JZError("Unterminated template string (`...`)", start_pos.first, start_pos.second);
+                }
+                flush_text();
+                segments.push_back({Segment::S_TEMPLATE, string(), eval::compile_template_program(acc, symbols)});
+                continue;
+            }
+
+            if (in_string) {
+                text.push_back(c);
+                if (escape) escape = false;
+                else {
+                    if (c == '\\') escape = true;
+                    else if (c == delim) {
+                        in_string = false;
+                        delim = 0;
+                    }
+                }
+                continue;
+            }
+
+            if (c == '"' || c == '\'') {
+                in_string = true;
+                delim = c;
+                text.push_back(c);
+                continue;
+            }
+
+            // handle $(expr) replacement
+            if (c == '$' && sc.peek() == '(') {
+                sc.advance(); // skip '('
+                int depth = 1;
+                bool str_in = false;
+                bool str_esc = false;
+                char str_delim = 0;
+                size_t expr_start_idx = sc.pos();
+                size_t expr_start_line = sc.line, expr_start_col = sc.col;
+                while (!sc.eof()) {
+                    if (!str_esc) sc.skip_to(cursor.next(sc.pos()));
+                    if (sc.eof()) break;
+                    char ch = sc.next();
+                    if (str_in) {
+                        if (str_esc) {
+                            str_esc = false;
+                            continue;
+                        }
+                        if (ch == '\\') {
+                            str_esc = true;
+                            continue;
+                        }
+                        if (ch == str_delim) {
+                            str_in = false;
+                            str_delim = 0;
+                        }
+                    } else {
+                        if (ch == '"' || ch == '\'') {
+                            str_in = true;
+                            str_delim = ch;
+                            continue;
+                        }
+                        if (ch == '(') ++depth;
+                        else if (ch == ')') { if (--depth == 0) break; }
+                    }
+                }
+                if (depth != 0) throw JZError("Unterminated $(...) placeholder", expr_start_line, expr_start_col);
+                size_t expr_end_idx = sc.pos() - 1;
+                flush_text();
+                segments.push_back({
+                    Segment::S_PLACEHOLDER, string(),
+                    eval::Parser::compile(sc.s.substr(expr_start_idx, expr_end_idx - expr_start_idx), symbols)
+                });
+                continue;
+            }
+
+            text.push_back(c);
+        }
+        flush_text();
+
+        return segments;
+    }
+
+    /* -------------------------
+       OutputSink
+       ------------------------- */
+    OutputSink::OutputSink(Writer writer, const size_t chunk_size)
+        : _writer(std::move(writer)), _chunk_size(max<size_t>(chunk_size, 1)) {
+        _buffer.reserve(_chunk_size);
+    }
+
+    OutputSink::OutputSink(ostream &os, const size_t chunk_size)
+        : OutputSink([&os](const string_view chunk) { os.write(chunk.data(), static_cast<streamsize>(chunk.size())); },
+                     chunk_size) {
+    }
+
+    void OutputSink::append(const string_view s) {
+        if (_buffer.size() + s.size() <= _chunk_size) {
+            _buffer.append(s);
+            return;
+        }
+        flush();
+        if (s.size() < _chunk_size) {
+            _buffer.append(s);
+            return;
+        }
+        _writer(s);
+        _written += s.size();
+    }
+
+    void OutputSink::flush() {
+        if (_buffer.empty()) return;
+        _writer(_buffer);
+        _written += _buffer.size();
+        _buffer.clear();
+    }
+
+    // nlohmann serializer output adapter writing into a sink: values are dumped without an intermediate string
+    struct SinkAdapter final : nlohmann::detail::output_adapter_protocol<char> {
+        OutputSink &sink;
+
+        explicit SinkAdapter(OutputSink &sink_) : sink(sink_) {
+        }
+
+        void write_character(const char c) override { sink += c; }
+        void write_characters(const char *s, const size_t length) override { sink += string_view(s, length); }
+    };
+
+    // append the compact JSON of a value (as dump())
+    template<typename Out>
+    static void append_json(Out &out, const ordered_json &j) {
+        out += j.dump();
+    }
+
+    static void append_json(OutputSink &out, const ordered_json &j) {
+        nlohmann::detail::serializer<ordered_json> serializer(std::make_shared<SinkAdapter>(out), ' ');
+        serializer.dump(j, false, false, 0);
+    }
+
+    /* Out: std::string, Json5Normalizer (streams the rendered text straight into normalization) or OutputSink
+       undefined placeholders are written as the sentinel text, or as the bare word `undefined` into the
+       normalizer (the to_json text path, where it fails the parse unless left out); returns whether there were any
+    */
+    template<typename Out>
+    static bool render_segments(const vector<Segment> &segments, const eval::Scope &scope, json &metadata,
+                                Out &out) {
+        const eval::Evaluator ev{scope, metadata};
+        bool undefined = false;
+        for (const auto &seg: segments) {
+            switch (seg.kind) {
+                case Segment::S_TEXT:
+                    out += seg.text;
+                    break;
+                case Segment::S_PLACEHOLDER: {
+                    const eval::Value val = ev.run(seg.program);
+                    if (eval::is_undefined(val)) {
+                        if constexpr (std::is_same_v<Out, Json5Normalizer>) out += "undefined";
+                        else out += UNDEF_TEXT;
+                        undefined = true;
+                    } else append_json(out, val.j());
+                    break;
+                }
+                case Segment::S_TEMPLATE:
+                    // produce JSON string literal from the interpolated text
+                    append_json(out, ev.run(seg.program).j());
+                    break;
+            }
+        }
+        return undefined;
+    }
+
+    string Processor::replace_placeholders(string_view s, const ordered_json &data, json &metadata) {
+        string out;
+        out.reserve(s.size());
+        eval::Symbols symbols;
+        render_segments(compile_segments(s, symbols), eval::DataRoot(data).scope, metadata, out);
+        return out;
+    }
+
+    bool Processor::is_undefined(const ordered_json &j) noexcept {
+        return is_undefined_sentinel(j);
+    }
+
+    /* remove_undefined_sentinels (in place):
+       - remove object properties with the undefined sentinel
+       - filter out undefined sentinel elements from arrays
+    */
+    void Processor::remove_undefined_sentinels(ordered_json &j) {
+        if (j.is_object()) {
+            auto &members = j.get_ref<ordered_json::object_t &>();
+            for (auto it = members.begin(); it != members.end();) {
+                if (is_undefined_sentinel(it->second)) it = members.erase(it);
+                else remove_undefined_sentinels((it++)->second);
+            }
         } else if (j.is_array()) {
-            ordered_json new_arr = ordered_json::array();
-            for (auto &el: j) {
+            auto &elements = j.get_ref<ordered_json::array_t &>();
+            size_t kept = 0;
+            for (auto &el: elements) {
                 if (is_undefined_sentinel(el)) continue;
                 remove_undefined_sentinels(el);
-                new_arr.push_back(std::move(el));
+                if (&elements[kept] != &el) elements[kept] = std::move(el);
+                ++kept;
             }
-            j = std::move(new_arr);
+            elements.resize(kept);
         }
     }
 
     /* -------------------------
-       Public API: to_json
-       1) remove comments
-       2) replace placeholders / evaluate templates
+       Template structure (direct rendering)
+       - when every placeholder/backtick template of a template sits in a JSON value or key position, the
+         JSON5 structure is parsed once at compile time into an OutNode tree
+       - rendering then builds the ordered_json result directly and moves evaluated values into place,
+         skipping the dump / normalize / parse round trip of the text path
+       - anything the tree cannot represent (values glued to other text, invalid JSON, ...) keeps using the
+         text path, so results and errors are unchanged
        ------------------------- */
-    string Processor::to_string(const string_view jz_input, const ordered_json &data, json &metadata) {
-        // 1) comments
-        const auto no_comments = remove_comments(jz_input);
+    struct OutMember;
+
+    struct OutNode {
+        enum Kind { O_CONST, O_SEGMENT, O_OBJECT, O_ARRAY };
+
+        Kind kind;
+        ordered_json value; // O_CONST
+        const Segment *segment = nullptr; // O_SEGMENT: placeholder or backtick template
+        vector<OutMember> members; // O_OBJECT
+        vector<OutNode> elements; // O_ARRAY
+        bool streamable = false; // O_OBJECT: constant distinct keys, members can be written one after the other
+    };
+
+    struct OutMember {
+        string key;
+        const Segment *key_segment = nullptr; // placeholder or backtick template used as key
+        string key_json; // constant key as a JSON string (streaming)
+        OutNode value;
+    };
+
+    // thrown while rendering a key the tree cannot represent: the text path then reproduces the legacy result
+    struct TextPathFallback {
+    };
+
+    struct StructureParser {
+        struct Tok {
+            enum Kind { K_PUNCT, K_STRING, K_BARE, K_SEGMENT, K_EOF };
+
+            Kind kind;
+            char punct = 0;
+            string text;
+            const Segment *segment = nullptr;
+        };
+
+        vector<Tok> toks;
+        size_t p = 0;
+
+        static bool is_json_ws(const char c) noexcept { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+        static bool is_punct(const char c) noexcept {
+            return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+        }
+
+        // decode a single or double quoted string token exactly as the text path would
+        static bool string_value(const string_view tok, string &out) {
+            // no escapes and printable ASCII only: the content is the value
+            const string_view content = tok.substr(1, tok.size() - 2);
+            if (std::all_of(content.begin(), content.end(), [](const char ch) {
+                return ch >= 0x20 && ch < 0x7f && ch != '\\';
+            })) {
+                out.assign(content);
+                return true;
+            }
+            try {
+                const auto j = ordered_json::parse(Processor::convert_single_quoted_strings(tok));
+                if (!j.is_string()) return false;
+                out = j.get<string>();
+                return true;
+            } catch (...) {
+                return false;
+            }
+        }
+
+        bool tokenize(const vector<Segment> &segments) {
+            for (const auto &seg: segments) {
+                if (seg.kind != Segment::S_TEXT) {
+                    toks.push_back({Tok::K_SEGMENT, 0, string(), &seg});
+                    continue;
+                }
+                const string_view s = seg.text;
+                StructuralScanner::Cursor cursor(STRING_STRUCTURAL, s);
+                size_t i = 0;
+                while (i < s.size()) {
+                    const char c = s[i];
+                    if (is_json_ws(c)) {
+                        ++i;
+                    } else if (is_punct(c)) {
+                        toks.push_back({Tok::K_PUNCT, c, string(), nullptr});
+                        ++i;
+                    } else if (c == '"' || c == '\'') {
+                        size_t j = i + 1;
+                        bool esc = false;
+                        while (j < s.size()) {
+                            if (!esc && (j = cursor.next(j)) >= s.size()) break;
+                            if (esc) esc = false;
+                            else if (s[j] == '\\') esc = true;
+                            else if (s[j] == c) break;
+                            ++j;
+                        }
+                        if (j >= s.size()) return false;
+                        string value;
+                        if (!string_value(s.substr(i, j + 1 - i), value)) return false;
+                        toks.push_back({Tok::K_STRING, 0, std::move(value), nullptr});
+                        i = j + 1;
+                    } else {
+                        size_t j = i;
+                        while (j < s.size() && !is_json_ws(s[j]) && !is_punct(s[j]) && s[j] != '"' && s[j] != '\'')
+                            ++j;
+                        toks.push_back({Tok::K_BARE, 0, string(s.substr(i, j - i)), nullptr});
+                        i = j;
+                    }
+                }
+            }
+            toks.push_back({Tok::K_EOF, 0, string(), nullptr});
+            return true;
+        }
+
+        [[nodiscard]] bool is_punct_tok(const char c) const { return toks[p].kind == Tok::K_PUNCT && toks[p].punct == c; }
+
+        static bool is_identifier(const string_view s) {
+            if (s.empty() || !Processor::is_identifier_start(s[0])) return false;
+            return std::all_of(s.begin() + 1, s.end(), Processor::is_identifier_part);
+        }
+
+        bool parse_value(OutNode &out) {
+            const Tok &t = toks[p];
+            switch (t.kind) {
+                case Tok::K_SEGMENT:
+                    out.kind = OutNode::O_SEGMENT;
+                    out.segment = t.segment;
+                    ++p;
+                    return true;
+                case Tok::K_STRING:
+                    out.kind = OutNode::O_CONST;
+                    out.value = t.text;
+                    ++p;
+                    return true;
+                case Tok::K_BARE:
+                    try {
+                        out.value = ordered_json::parse(t.text);
+                    } catch (...) {
+                        return false;
+                    }
+                    if (out.value.is_structured()) return false;
+                    out.kind = OutNode::O_CONST;
+                    ++p;
+                    return true;
+                case Tok::K_PUNCT:
+                    if (t.punct == '{') return parse_object(out);
+                    if (t.punct == '[') return parse_array(out);
+                    return false;
+                case Tok::K_EOF:
+                    return false;
+            }
+            return false;
+        }
+
+        bool parse_object(OutNode &out) {
+            ++p; // '{'
+            out.kind = OutNode::O_OBJECT;
+            while (!is_punct_tok('}')) {
+                const Tok &k = toks[p];
+                OutMember member;
+                if (k.kind == Tok::K_STRING) member.key = k.text;
+                else if (k.kind == Tok::K_BARE && is_identifier(k.text)) member.key = k.text;
+                else if (k.kind == Tok::K_SEGMENT) member.key_segment = k.segment;
+                else return false;
+                ++p;
+                if (!is_punct_tok(':')) return false;
+                ++p;
+                if (!parse_value(member.value)) return false;
+                out.members.push_back(std::move(member));
+                if (is_punct_tok(',')) ++p;
+                else if (!is_punct_tok('}')) return false;
+            }
+            ++p; // '}'
+            unordered_set<string_view> keys;
+            out.streamable = true;
+            for (auto &m: out.members) {
+                if (m.key_segment || !keys.insert(m.key).second) {
+                    out.streamable = false;
+                    break;
+                }
+                m.key_json = ordered_json(m.key).dump();
+            }
+            fold_constants(out);
+            return true;
+        }
+
+        bool parse_array(OutNode &out) {
+            ++p; // '['
+            out.kind = OutNode::O_ARRAY;
+            while (!is_punct_tok(']')) {
+                OutNode value;
+                if (!parse_value(value)) return false;
+                out.elements.push_back(std::move(value));
+                if (is_punct_tok(',')) ++p;
+                else if (!is_punct_tok(']')) return false;
+            }
+            ++p; // ']'
+            fold_constants(out);
+            return true;
+        }
 
-        // 2) placeholders and backtick templates
-        return replace_placeholders(no_comments, data, metadata);
+        // objects/arrays without placeholders are built once here and copied on render
+        static void fold_constants(OutNode &n) {
+            if (n.kind == OutNode::O_OBJECT) {
+                if (!ranges::all_of(n.members, [](const auto &m) {
+                    return !m.key_segment && m.value.kind == OutNode::O_CONST;
+                }))
+                    return;
+                ordered_json obj = ordered_json::object();
+                for (auto &m: n.members) obj[m.key] = std::move(m.value.value);
+                n.members.clear();
+                n.value = std::move(obj);
+            } else {
+                if (!ranges::all_of(n.elements, [](const auto &e) { return e.kind == OutNode::O_CONST; }))
+                    return;
+                ordered_json arr = ordered_json::array();
+                for (auto &el: n.elements) arr.push_back(std::move(el.value));
+                n.elements.clear();
+                n.value = std::move(arr);
+            }
+            n.kind = OutNode::O_CONST;
+        }
+
+        // build the tree for a whole template; nullopt when the text path must be used
+        static optional<OutNode> parse(const vector<Segment> &segments) {
+            StructureParser sp;
+            if (!sp.tokenize(segments)) return nullopt;
+            OutNode root;
+            if (!sp.parse_value(root) || sp.toks[sp.p].kind != Tok::K_EOF) return nullopt;
+            return root;
+        }
+    };
+
+    /* key of a placeholder/backtick template member, as the text path reads it:
+       strings as they are, true/false/null as the bare words (quoted as keys by the normalizer);
+       other values make the text invalid, so the text path is used to report the same error
+    */
+    static string render_key(const Segment &seg, const eval::Evaluator &ev) {
+        eval::Value val = ev.run(seg.program);
+        if (eval::is_undefined(val)) throw TextPathFallback{};
+        const ordered_json &key = val.j();
+        if (key.is_string()) return std::move(val).take().get<string>();
+        if (key.is_boolean() || key.is_null()) return key.dump();
+        throw TextPathFallback{};
+    }
+
+    // render a structure node into `out`; returns false when the node evaluates to undefined
+    static bool render_node(const OutNode &n, const eval::Evaluator &ev, ordered_json &out) {
+        switch (n.kind) {
+            case OutNode::O_CONST:
+                out = n.value;
+                return true;
+            case OutNode::O_SEGMENT: {
+                const Segment &seg = *n.segment;
+                if (seg.kind == Segment::S_TEMPLATE) {
+                    out = ev.run(seg.program).take();
+                    return true;
+                }
+                eval::Value val = ev.run(seg.program);
+                if (eval::is_undefined(val)) return false;
+                out = std::move(val).take();
+                return true;
+            }
+            case OutNode::O_OBJECT:
+                out = ordered_json::object();
+                for (const auto &member: n.members) {
+                    string dynamic_key;
+                    if (member.key_segment) dynamic_key = render_key(*member.key_segment, ev);
+                    const string &key = member.key_segment ? dynamic_key : member.key;
+                    ordered_json value;
+                    if (render_node(member.value, ev, value)) out[key] = std::move(value);
+                    else out.erase(key); // an undefined duplicate key removes the earlier value too
+                }
+                return true;
+            case OutNode::O_ARRAY:
+                out = ordered_json::array();
+                out.get_ref<ordered_json::array_t &>().reserve(n.elements.size());
+                for (const auto &element: n.elements) {
+                    ordered_json value;
+                    if (render_node(element, ev, value)) out.push_back(std::move(value));
+                }
+                return true;
+        }
+        return false;
+    }
+
+    /* write a structure node into the sink as compact JSON, the same text as dump() of render_node's result;
+       `sep` and `key` (array/object separator and member key) are written first, only when the node is defined;
+       returns false when the node evaluates to undefined
+    */
+    static bool stream_node(const OutNode &n, const eval::Evaluator &ev, OutputSink &sink, const char sep = 0,
+                            const string *key = nullptr) {
+        const auto open = [&] {
+            if (sep) sink += sep;
+            if (key) {
+                sink += *key;
+                sink += ':';
+            }
+        };
+        switch (n.kind) {
+            case OutNode::O_CONST:
+                open();
+                append_json(sink, n.value);
+                return true;
+            case OutNode::O_SEGMENT: {
+                const eval::Value val = ev.run(n.segment->program);
+                if (n.segment->kind != Segment::S_TEMPLATE && eval::is_undefined(val)) return false;
+                open();
+                append_json(sink, val.j());
+                return true;
+            }
+            case OutNode::O_OBJECT: {
+                if (!n.streamable) {
+                    // computed or repeated keys: the object is built whole
+                    ordered_json value;
+                    render_node(n, ev, value);
+                    open();
+                    append_json(sink, value);
+                    return true;
+                }
+                open();
+                sink += '{';
+                bool first = true;
+                for (const auto &member: n.members)
+                    if (stream_node(member.value, ev, sink, first ? 0 : ',', &member.key_json)) first = false;
+                sink += '}';
+                return true;
+            }
+            case OutNode::O_ARRAY: {
+                open();
+                sink += '[';
+                bool first = true;
+                for (const auto &element: n.elements)
+                    if (stream_node(element, ev, sink, first ? 0 : ',')) first = false;
+                sink += ']';
+                return true;
+            }
+        }
+        return false;
     }
 
     /* -------------------------
-       Public API: to_json
-       1) to_string
+       CompiledTemplate
+       - immutable result of Processor::compile: comments removed and template split into segments,
+         every $(...) expression parsed into a Node tree, JSON5 structure parsed into an OutNode tree when possible
+       - render/render_string only evaluate; a compiled template can be shared between threads
+       ------------------------- */
+    struct CompiledTemplate::Impl {
+        eval::Symbols symbols; // path keys of the compiled expressions
+        vector<Segment> segments;
+        optional<OutNode> structure; // direct rendering; text path when empty
+        size_t source_size = 0;
+    };
+
+    CompiledTemplate::CompiledTemplate(std::shared_ptr<const Impl> impl) : _impl(std::move(impl)) {
+    }
+
+    static size_t node_memory_size(const OutNode &n) noexcept {
+        size_t size = sizeof(OutNode);
+        if (n.kind == OutNode::O_CONST && n.value.is_structured()) size += n.value.size() * sizeof(ordered_json);
+        for (const auto &m: n.members) size += m.key.size() + m.key_json.size() + node_memory_size(m.value);
+        for (const auto &e: n.elements) size += node_memory_size(e);
+        return size;
+    }
+
+    size_t CompiledTemplate::memory_size() const noexcept {
+        if (!_impl) return 0;
+        size_t size = sizeof(Impl) + _impl->symbols.memory_size();
+        for (const auto &seg: _impl->segments) size += sizeof(Segment) + seg.text.size() + seg.program.memory_size();
+        if (_impl->structure) size += node_memory_size(*_impl->structure);
+        return size;
+    }
+
+    string CompiledTemplate::render_string(const ordered_json &data, json &metadata) const {
+        if (!_impl) throw JZError("Rendering an empty compiled template", 0, 0);
+        const RenderArena::Scope arena;
+        string out;
+        out.reserve(_impl->source_size);
+        render_segments(_impl->segments, eval::DataRoot(data).scope, metadata, out);
+        arena.report(metadata);
+        return out;
+    }
+
+    void CompiledTemplate::render_string(const ordered_json &data, json &metadata, OutputSink &sink) const {
+        if (!_impl) throw JZError("Rendering an empty compiled template", 0, 0);
+        const RenderArena::Scope arena;
+        render_segments(_impl->segments, eval::DataRoot(data).scope, metadata, sink);
+        arena.report(metadata);
+        sink.flush();
+    }
+
+    ordered_json CompiledTemplate::render(const ordered_json &data, json &metadata) const {
+        // an undefined root renders as the sentinel object
+        auto j = render_optional(data, metadata);
+        return j ? std::move(*j) : undefined_sentinel();
+    }
+
+    // root scope of a document read on demand
+    static eval::Scope lazy_root(const LazyDocument &data) {
+        eval::Scope scope;
+        scope.lazy = &data;
+        return scope;
+    }
+
+    ordered_json CompiledTemplate::render(const LazyDocument &data, json &metadata) const {
+        const RenderArena::Scope arena;
+        auto j = render_scoped(lazy_root(data), metadata);
+        arena.report(metadata);
+        return j ? std::move(*j) : undefined_sentinel();
+    }
+
+    string CompiledTemplate::render_string(const LazyDocument &data, json &metadata) const {
+        if (!_impl) throw JZError("Rendering an empty compiled template", 0, 0);
+        const RenderArena::Scope arena;
+        string out;
+        out.reserve(_impl->source_size);
+        render_segments(_impl->segments, lazy_root(data), metadata, out);
+        arena.report(metadata);
+        return out;
+    }
+
+    /*
+       direct rendering when the template structure is known, otherwise the text path:
+       1) render segments (as render_string)
        2) normalize json5-like to JSON
        3) parse into ordered_json
-       4) remove undefined sentinels
-       ------------------------- */
-    ordered_json Processor::to_json(const string_view jz_input, const ordered_json &data, json &metadata) {
-        // 1) to_string
-        const auto with_values = to_string(jz_input, data, metadata);
+    */
+    optional<ordered_json> CompiledTemplate::render_optional(const ordered_json &data, json &metadata) const {
+        const RenderArena::Scope arena;
+        auto j = render_scoped(eval::DataRoot(data).scope, metadata);
+        arena.report(metadata);
+        return j;
+    }
+
+    optional<ordered_json> CompiledTemplate::render_scoped(const eval::Scope &scope, json &metadata) const {
+        if (!_impl) throw JZError("Rendering an empty compiled template", 0, 0);
+        // tool blocks rendered on pool threads open the arena of their thread
+        const RenderArena::Scope arena;
+
+        if (_impl->structure) {
+            try {
+                ordered_json j;
+                if (!render_node(*_impl->structure, eval::Evaluator{scope, metadata}, j)) return nullopt;
+                return j;
+            } catch (const TextPathFallback &) {
+                // a key the tree cannot represent: the text path reports the error
+            }
+        }
+        return render_text(scope, metadata);
+    }
 
-        // 2) normalize JSON5-ish constructs
-        auto jsonish = normalize_json5_to_json(with_values);
+    optional<ordered_json> CompiledTemplate::render_text(const eval::Scope &scope, json &metadata) const {
+        // 1) placeholders and backtick templates, 2) normalize JSON5-ish constructs (single pass, streamed)
+        Json5Normalizer normalizer(Json5Normalizer::JSON5, _impl->source_size);
+        const bool undefined = render_segments(_impl->segments, scope, metadata, normalizer);
+        auto jsonish = normalizer.finish();
+        ordered_json j;
         try {
             // 3) parse -> note: nlohmann::json parse takes std::string
-            ordered_json j = ordered_json::parse(jsonish);
-            // 4) remove undefined sentinels
-            remove_undefined_sentinels(j);
-            return j;
+            j = ordered_json::parse(jsonish);
         } catch (const std::exception &e) {
             // we want to throw JZError including message and (approx) first line/col of failure
             // find position by naive heuristics: look for first occurrence of problematic substring
             // For simplicity, throw with line 1 col 1 (could be improved by analyzing exception message)
             throw JZError(std::format("Invalid JSON after JZ transform: {}", e.what()), jsonish);
         }
+        // undefined values that can be left out are handled by the structure tree: here the bare word was
+        // quoted as an object key
+        if (undefined) throw JZError("Invalid JSON after JZ transform: object key evaluated to undefined", jsonish);
+        return j;
+    }
+
+    /*
+       streaming: the structure tree is written node by node, the text path result is serialized once parsed
+    */
+    bool CompiledTemplate::render(const ordered_json &data, json &metadata, OutputSink &sink) const {
+        if (!_impl) throw JZError("Rendering an empty compiled template", 0, 0);
+        const RenderArena::Scope arena;
+        const eval::DataRoot root(data);
+        const eval::Scope &scope = root.scope;
+
+        if (_impl->structure) {
+            bool defined;
+            try {
+                defined = stream_node(*_impl->structure, eval::Evaluator{scope, metadata}, sink);
+            } catch (const TextPathFallback &) {
+                // a key the tree cannot represent: the text path reports the error (the key fails it)
+                static_cast<void>(render_text(scope, metadata));
+                throw JZError("Invalid JSON after JZ transform: invalid object key", 0, 0);
+            }
+            arena.report(metadata);
+            sink.flush();
+            return defined;
+        }
+
+        const auto j = render_text(scope, metadata);
+        arena.report(metadata);
+        if (!j) return false;
+        append_json(sink, *j);
+        sink.flush();
+        return true;
+    }
+
+    /* -------------------------
+       Public API: compile
+       1) remove comments
+       2) split into text / placeholder / template segments, parsing every expression
+       3) parse the JSON5 structure for direct rendering (when representable)
+       ------------------------- */
+    CompiledTemplate Processor::compile(const string_view jz_input) {
+        auto impl = std::make_shared<CompiledTemplate::Impl>();
+        impl->segments = compile_segments(remove_comments(jz_input), impl->symbols);
+        impl->structure = StructureParser::parse(impl->segments);
+        impl->source_size = jz_input.size();
+        return CompiledTemplate(std::move(impl));
+    }
+
+    /* -------------------------
+       Public API: to_string
+       compile (through the template cache when enabled) + render_string
+       ------------------------- */
+    string Processor::to_string(const string_view jz_input, const ordered_json &data, json &metadata) {
+        return TemplateCache::instance().compile(jz_input).render_string(data, metadata);
+    }
+
+    void Processor::to_string(const string_view jz_input, const ordered_json &data, json &metadata,
+                              OutputSink &sink) {
+        TemplateCache::instance().compile(jz_input).render_string(data, metadata, sink);
+    }
+
+    /* -------------------------
+       Public API: to_json
+       compile (through the template cache when enabled) + render
+       ------------------------- */
+    ordered_json Processor::to_json(const string_view jz_input, const ordered_json &data, json &metadata) {
+        return TemplateCache::instance().compile(jz_input).render(data, metadata);
+    }
+
+    bool Processor::to_json(const string_view jz_input, const ordered_json &data, json &metadata, OutputSink &sink) {
+        return TemplateCache::instance().compile(jz_input).render(data, metadata, sink);
+    }
+
+    string Processor::to_string(const string_view jz_input, const LazyDocument &data, json &metadata) {
+        return TemplateCache::instance().compile(jz_input).render_string(data, metadata);
+    }
+
+    ordered_json Processor::to_json(const string_view jz_input, const LazyDocument &data, json &metadata) {
+        return TemplateCache::instance().compile(jz_input).render(data, metadata);
+    }
+
+    /* -------------------------
+       Public API: render_batch
+       compile once + render every document on the shared thread pool
+       ------------------------- */
+    vector<BatchResult> Processor::render_batch(const string_view jz_input, const span<const ordered_json> inputs,
+                                                const json &metadata) {
+        return render_batch(TemplateCache::instance().compile(jz_input), inputs, metadata);
+    }
+
+    vector<BatchResult> Processor::render_batch(const CompiledTemplate &compiled, const span<const ordered_json> inputs,
+                                                const json &metadata) {
+        vector<BatchResult> results(inputs.size());
+        ThreadPool::shared().parallel_for(inputs.size(), [&](const size_t i) {
+            BatchResult &r = results[i];
+            r.metadata = metadata;
+            try {
+                r.output = compiled.render(inputs[i], r.metadata);
+            } catch (...) {
+                r.output = nullptr;
+                r.error = current_exception();
+            }
+        });
+        return results;
+    }
+
+    string BatchResult::error_message() const {
+        if (!error) return {};
+        try {
+            rethrow_exception(error);
+        } catch (const exception &e) {
+            return e.what();
+        } catch (...) {
+            return "unknown error";
+        }
+    }
+
+    /* -------------------------
+       Public API: template cache
+       ------------------------- */
+    void Processor::enable_template_cache(const size_t byte_budget) {
+        TemplateCache::instance().enable(byte_budget);
+    }
+
+    void Processor::disable_template_cache() {
+        TemplateCache::instance().disable();
+    }
+
+    TemplateCacheStats Processor::template_cache_stats() {
+        return TemplateCache::instance().stats();
+    }
+
+    void Processor::set_regex_cache_capacity(const size_t capacity) {
+        RegexCache::instance().set_capacity(capacity);
+    }
+
+    RegexCacheStats Processor::regex_cache_stats() {
+        return RegexCache::instance().stats();
+    }
+
+    /* -------------------------
+       Public API: parallel loops
+       ------------------------- */
+    void Processor::set_parallel_loops(const bool enabled, const size_t min_items) {
+        eval::parallel_min_items.store(enabled ? max<size_t>(min_items, 2) : 0, memory_order_relaxed);
+    }
+
+    /* -------------------------
+       Public API: render arena report
+       ------------------------- */
+    void Processor::set_arena_report(const bool enabled) {
+        RenderArena::set_report(enabled);
     }
 } // namespace jz
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <format>
 #include <string_view>
 #include <stdexcept>
+#include <vector>
 #include <nlohmann/json.hpp>
 
+#include "LazyDocument.hpp"
+
 using std::string;
 using std::string_view;
 using std::runtime_error;
@@ -52,6 +61,253 @@ namespace jz {
         // std::string full_msg; // cached message returned by what()
     };
 
+    /*
+     Json5Normalizer
+     - single forward pass over a JZ/JSON5 buffer applying the selected stages, chained in this order:
+       comments removal -> single-quoted strings -> unquoted keys quoting -> trailing commas removal
+     - each stage is a small character state machine feeding the next one: input is read once and
+       written once into a single output buffer; input can be appended in chunks (streaming)
+     - finish() reports unterminated block comments / single-quoted strings as JZError (1-based line/column)
+    */
+    class Json5Normalizer {
+    public:
+        enum Stage : unsigned {
+            STRIP_COMMENTS = 1u << 0,
+            SINGLE_QUOTES = 1u << 1,
+            QUOTE_KEYS = 1u << 2,
+            TRAILING_COMMAS = 1u << 3,
+            JSON5 = SINGLE_QUOTES | QUOTE_KEYS | TRAILING_COMMAS,
+            ALL = STRIP_COMMENTS | JSON5
+        };
+
+        explicit Json5Normalizer(unsigned stages = ALL, size_t reserve = 0);
+
+        // feed the next chunk of input
+        void append(string_view chunk);
+
+        Json5Normalizer &operator+=(const string_view chunk) {
+            append(chunk);
+            return *this;
+        }
+
+        // flush pending lookahead, check for unterminated constructs and return the output
+        string finish();
+
+        // one-shot convenience
+        static string run(string_view s, unsigned stages = ALL);
+
+    private:
+        enum class Ctx { None, InObject, InArray };
+
+        struct Frame {
+            Ctx ctx;
+            bool expecting_key;
+        };
+
+        enum BulkClass { BULK_NORMAL, BULK_STRING, BULK_LINE_COMMENT, BULK_BLOCK_COMMENT, BULK_NONE };
+
+        BulkClass bulk_class(bool &emit) const;
+
+        void put_comments(char c);
+        bool step_comments(char c, char nextc);
+        void put_quotes(char c);
+        void put_keys(char c);
+        void step_keys(char c);
+        bool scan_key(char c);
+        void put_commas(char c);
+
+        unsigned _stages;
+        string _out;
+
+        // input position (1-based) for error reporting
+        size_t _line = 1;
+        size_t _col = 1;
+
+        // comments stage
+        bool _in_line_comment = false;
+        bool _in_block_comment = false;
+        bool _c_in_string = false;
+        char _c_delim = 0;
+        bool _c_escape = false;
+        bool _c_has_pending = false;
+        char _c_pending = 0;
+
+        // single-quotes stage
+        bool _q_in_string = false;
+        char _q_delim = 0;
+        bool _q_escape = false;
+
+        // keys stage
+        std::vector<Frame> _stack;
+        bool _k_in_string = false;
+        char _k_delim = 0;
+        bool _k_escape = false;
+        string _key; // identifier (+ whitespace) waiting for a ':' to be confirmed as a key
+        size_t _key_ws = string::npos; // start of whitespace in _key
+        string _replay;
+
+        // trailing commas stage
+        bool _t_in_string = false;
+        char _t_delim = 0;
+        bool _t_escape = false;
+        string _comma; // ',' plus following whitespace, dropped if a closing bracket follows
+    };
+
+    /*
+     OutputSink
+     - receives rendered output incrementally (streaming overloads of to_string / to_json): text is gathered
+       into chunks of up to chunk_size bytes handed to the writer, so memory stays bounded by the chunk size
+       rather than by the output size; pieces larger than a chunk are passed through without copying
+     - the renders flush() the last partial chunk when they are done (the destructor does not)
+    */
+    class OutputSink {
+    public:
+        using Writer = std::function<void(string_view chunk)>;
+
+        static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+        explicit OutputSink(Writer writer, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+        // chunks are written to `os`
+        explicit OutputSink(std::ostream &os, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+        void append(string_view s);
+
+        void append(const char c) {
+            if (_buffer.size() >= _chunk_size) flush();
+            _buffer.push_back(c);
+        }
+
+        OutputSink &operator+=(const string_view s) {
+            append(s);
+            return *this;
+        }
+
+        OutputSink &operator+=(const char c) {
+            append(c);
+            return *this;
+        }
+
+        // hand the buffered text to the writer
+        void flush();
+
+        // bytes received so far (written or buffered)
+        [[nodiscard]] size_t size() const noexcept { return _written + _buffer.size(); }
+
+    private:
+        Writer _writer;
+        size_t _chunk_size;
+        string _buffer;
+        size_t _written = 0;
+    };
+
+    namespace eval {
+        struct Scope;
+        struct Evaluator;
+    }
+
+    /*
+     CompiledTemplate
+     - immutable result of Processor::compile: the template is parsed once (comments, placeholders,
+       backtick templates, expressions, pipelines and tool blocks) and can then be rendered many times.
+     - cheap to copy (shared state) and safe to share between threads: render never mutates it.
+    */
+    class CompiledTemplate {
+    public:
+        CompiledTemplate() = default;
+
+        // Render the template as JSON, using `data` as the input context (same result as Processor::to_json).
+        // Throws JZError on eval/formatting errors.
+        [[nodiscard]] ordered_json render(const ordered_json &data, json &metadata) const;
+
+        // Same as render, but an undefined result is returned as nullopt instead of the undefined sentinel object.
+        [[nodiscard]] std::optional<ordered_json> render_optional(const ordered_json &data, json &metadata) const;
+
+        // Render the template as text, using `data` as the input context (same result as Processor::to_string).
+        // Throws JZError on eval errors.
+        [[nodiscard]] string render_string(const ordered_json &data, json &metadata) const;
+
+        // Streaming render: the JSON (compact, as dump() of render's result) is written to `sink` as it is
+        // produced; returns false when the result is undefined (nothing written). Values are serialized straight
+        // into the sink; objects are built whole only when their keys are computed or repeated.
+        // On error, what was written before stays in the sink.
+        bool render(const ordered_json &data, json &metadata, OutputSink &sink) const;
+
+        // Streaming render_string: the text is written to `sink` as it is produced.
+        void render_string(const ordered_json &data, json &metadata, OutputSink &sink) const;
+
+        // Render against a lazily read document: only the values the template reads are parsed.
+        [[nodiscard]] ordered_json render(const LazyDocument &data, json &metadata) const;
+
+        [[nodiscard]] string render_string(const LazyDocument &data, json &metadata) const;
+
+        [[nodiscard]] bool empty() const noexcept { return !_impl; }
+
+        // Approximate memory used by the compiled form (the template cache byte budget counts it).
+        [[nodiscard]] size_t memory_size() const noexcept;
+
+    private:
+        friend struct Processor;
+        friend struct eval::Evaluator;
+        struct Impl;
+
+        explicit CompiledTemplate(std::shared_ptr<const Impl> impl);
+
+        // render a tool block against the scope of its loop item (the data layered with the item bindings)
+        [[nodiscard]] std::optional<ordered_json> render_scoped(const eval::Scope &scope, json &metadata) const;
+
+        // render through the text (normalize + parse) path
+        [[nodiscard]] std::optional<ordered_json> render_text(const eval::Scope &scope, json &metadata) const;
+
+        std::shared_ptr<const Impl> _impl;
+    };
+
+    // counters of the compiled templates cache (Processor::enable_template_cache)
+    struct TemplateCacheStats {
+        static constexpr size_t DEFAULT_BYTE_BUDGET = 64 * 1024 * 1024;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0; // approximate memory of the cached entries
+        size_t byte_budget = 0;
+    };
+
+    // a cached regular expression (Processor::regex_cache_stats)
+    struct RegexStats {
+        string pattern;
+        string flags;
+        string engine; // "literal" (substring search) or "std::regex"
+        uint64_t compiles = 0; // times the pattern was compiled (again after an eviction)
+        uint64_t matches = 0; // searches and replacements run with it
+        uint64_t match_ns = 0; // time spent in them
+    };
+
+    // counters of the compiled regular expressions cache (regex tools and the =~ operator)
+    struct RegexCacheStats {
+        static constexpr size_t DEFAULT_CAPACITY = 512;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t capacity = 0;
+        std::vector<RegexStats> patterns; // the cached patterns, most recently used first
+    };
+
+    // one input document of Processor::render_batch
+    struct BatchResult {
+        ordered_json output; // as to_json (the undefined sentinel for an undefined result); null on error
+        json metadata; // the batch metadata as left by this document's render
+        std::exception_ptr error; // what rendering this document threw (JZError for template errors)
+
+        [[nodiscard]] bool ok() const noexcept { return !error; }
+
+        // what() of the error, empty when ok
+        [[nodiscard]] string error_message() const;
+    };
+
     /*
      Processor
      - static utility class that processes a JZ template (string) producing JSON output.
@@ -59,7 +315,12 @@ namespace jz {
      - many helper methods are static and internal-use; kept public static to match previous usage style.
     */
     struct Processor {
+        // Public API: parse a jz template once; the result can be rendered many times against different data.
+        // Throws JZError on parse errors.
+        static CompiledTemplate compile(string_view jz_input);
+
         // Public API: convert a jz template (jz_input) into string, using `data` as the input context.
+        // An undefined placeholder is written as the undefined sentinel ({"__jz_undefined__":true}).
         // Throws JZError on parse/eval/formatting errors.
         static string to_string(string_view jz_input, const ordered_json &data, json &metadata);
 
@@ -67,6 +328,58 @@ namespace jz {
         // Throws JZError on parse/eval/formatting errors.
         static ordered_json to_json(std::string_view jz_input, const ordered_json &data, json &metadata);
 
+        // Streaming variants: the output is written to `sink` as it is produced (see CompiledTemplate::render).
+        // to_json returns false when the result is undefined (nothing written).
+        static void to_string(string_view jz_input, const ordered_json &data, json &metadata, OutputSink &sink);
+
+        static bool to_json(string_view jz_input, const ordered_json &data, json &metadata, OutputSink &sink);
+
+        // Lazy input variants: `data` is read on demand (see LazyDocument), e.g. a memory-mapped file.
+        static string to_string(string_view jz_input, const LazyDocument &data, json &metadata);
+
+        static ordered_json to_json(string_view jz_input, const LazyDocument &data, json &metadata);
+
+        // Public API: render a jz template against many input documents. The template is compiled once (through
+        // the template cache when enabled), the documents are rendered on the shared thread pool and the results
+        // come back in input order. Each document starts from a copy of `metadata`; a document that fails records
+        // its error in its result and the others carry on.
+        // Throws JZError only when the template does not compile.
+        static std::vector<BatchResult> render_batch(string_view jz_input, std::span<const ordered_json> inputs,
+                                                     const json &metadata = json());
+
+        static std::vector<BatchResult> render_batch(const CompiledTemplate &compiled,
+                                                     std::span<const ordered_json> inputs,
+                                                     const json &metadata = json());
+
+        // Opt-in cache of compiled templates (see TemplateCache): once enabled, to_json/to_string (and tools
+        // rendering through them, e.g. include) reuse the compiled form of a template text seen before.
+        static void enable_template_cache(size_t byte_budget = TemplateCacheStats::DEFAULT_BYTE_BUDGET);
+
+        static void disable_template_cache();
+
+        static TemplateCacheStats template_cache_stats();
+
+        // Regular expressions (regex tools, =~) are compiled once and shared through a bounded cache (see
+        // RegexCache); constant patterns are compiled with the template.
+        static void set_regex_cache_capacity(size_t capacity = RegexCacheStats::DEFAULT_CAPACITY);
+
+        static RegexCacheStats regex_cache_stats();
+
+        static constexpr size_t DEFAULT_PARALLEL_MIN_ITEMS = 256;
+
+        // Opt-in parallel tool loops: `$` and anonymous tool loops over at least min_items items render their
+        // items on the shared thread pool; the output keeps the item order. Each item renders on its own empty
+        // metadata, merged in item order onto the loop's metadata (objects member by member, arrays appended to,
+        // other values replaced): tools in a parallel loop do not see the metadata written by the other items or
+        // present before the loop. A loop needing it opts out with the `$parallel` (`$` tools) / `parallel`
+        // (anonymous tools) option, which turns parallel rendering on or off for a single loop, whatever the policy.
+        static void set_parallel_loops(bool enabled, size_t min_items = DEFAULT_PARALLEL_MIN_ITEMS);
+
+        // Opt-in report of the render arena (see RenderArena): every render writes the scratch memory it used to
+        // its metadata, as "$arena": {"bytes": ..., "requested": ..., "blocks": ...} (bytes: peak in use,
+        // requested: total bytes allocated from it, blocks: heap blocks beyond the kept one).
+        static void set_arena_report(bool enabled);
+
         // --- Utilities used internally (but kept public static for testability) ---
 
         // Comment removal (handles // and /* */ and respects strings)
@@ -92,7 +405,11 @@ namespace jz {
         // Placeholder/template replacement:
         static std::string replace_placeholders(std::string_view s, const ordered_json &data, json &metadata);
 
-        // Recursively remove 'undefined' sentinel nodes from JSON (both objects and arrays)
+        // Recursively remove 'undefined' sentinel nodes from JSON (both objects and arrays), in place
         static void remove_undefined_sentinels(ordered_json &j);
+
+        // Whether j is the 'undefined' sentinel (to_json of an undefined result); a tool returning it yields undefined,
+        // so tools rendering through to_json (e.g. include) only have to drop it from the collections they build
+        static bool is_undefined(const ordered_json &j) noexcept;
     };
 } // namespace jz
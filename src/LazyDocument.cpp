@@ -0,0 +1,269 @@
+#include "LazyDocument.hpp"
+#include "JZParser.hpp"
+#include "StructuralScanner.hpp"
+
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+// memory mapping where the platform has it (POSIX); elsewhere files are read into memory
+#if __has_include(<sys/mman.h>)
+#define JZ_LAZY_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace jz {
+    // strings and brackets: enough to skip a nested value without looking at its other bytes
+    static const StructuralScanner CONTAINER_STRUCTURAL("\"\\{}[]");
+
+    /* Container: member table of an object / elements of an array, built on the first lookup */
+    struct Container {
+        size_t end = 0; // past the closing bracket
+        unordered_map<string, LazyDocument::Node> members;
+        vector<LazyDocument::Node> elements;
+    };
+
+    struct LazyDocument::Impl {
+        string owned; // text read into memory (from_string, or files that cannot be mapped)
+        void *map = nullptr;
+        size_t map_size = 0;
+        string_view text;
+        size_t root_begin = 0;
+
+        // caches keyed by the value's begin offset (entries are never removed: references stay valid)
+        mutable shared_mutex mutex;
+        mutable unordered_map<size_t, unique_ptr<const Container>> containers;
+        mutable unordered_map<size_t, unique_ptr<const ordered_json>> values;
+
+        Impl() = default;
+
+        Impl(const Impl &) = delete;
+
+        Impl &operator=(const Impl &) = delete;
+
+        ~Impl() {
+#ifdef JZ_LAZY_MMAP
+            if (map) munmap(map, map_size);
+#endif
+        }
+
+        [[noreturn]] static void fail(const size_t pos, const string_view what) {
+            throw JZError(std::format("Invalid JSON input at offset {}: {}", pos, what), 0, 0);
+        }
+
+        static bool is_ws(const char c) noexcept { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+        [[nodiscard]] size_t skip_ws(size_t p) const noexcept {
+            while (p < text.size() && is_ws(text[p])) ++p;
+            return p;
+        }
+
+        // p at the opening quote; returns the position past the closing one
+        [[nodiscard]] size_t skip_string(const size_t p) const {
+            StructuralScanner::Cursor cursor(CONTAINER_STRUCTURAL, text);
+            size_t q = p + 1;
+            while ((q = cursor.next(q)) < text.size()) {
+                if (text[q] == '\\') q += 2;
+                else if (text[q] == '"') return q + 1;
+                else ++q;
+            }
+            fail(p, "unterminated string");
+        }
+
+        // p at the first character of a value; returns the position past its end
+        [[nodiscard]] size_t skip_value(const size_t p) const {
+            if (p >= text.size()) fail(p, "unexpected end of input");
+            const char c = text[p];
+            if (c == '"') return skip_string(p);
+            if (c == '{' || c == '[') {
+                StructuralScanner::Cursor cursor(CONTAINER_STRUCTURAL, text);
+                size_t depth = 0;
+                bool in_string = false;
+                size_t q = p;
+                while ((q = cursor.next(q)) < text.size()) {
+                    const char s = text[q];
+                    if (s == '\\') {
+                        q += 2;
+                        continue;
+                    }
+                    if (s == '"') in_string = !in_string;
+                    else if (!in_string) {
+                        if (s == '{' || s == '[') ++depth;
+                        else if (--depth == 0) return q + 1;
+                    }
+                    ++q;
+                }
+                fail(p, c == '{' ? "unterminated object" : "unterminated array");
+            }
+            size_t q = p;
+            while (q < text.size() && !is_ws(text[q]) && text[q] != ',' && text[q] != '}' && text[q] != ']') ++q;
+            if (q == p) fail(p, "expected a value");
+            return q;
+        }
+
+        // p at the opening quote, end past the closing one
+        [[nodiscard]] string decode_string(const size_t p, const size_t end) const {
+            const string_view raw = text.substr(p + 1, end - p - 2);
+            if (raw.find('\\') == string_view::npos) return string(raw);
+            try {
+                return ordered_json::parse(text.substr(p, end - p)).get<string>();
+            } catch (const exception &e) {
+                fail(p, e.what());
+            }
+        }
+
+        [[nodiscard]] unique_ptr<const Container> scan_container(const size_t begin) const {
+            auto c = make_unique<Container>();
+            const bool object = text[begin] == '{';
+            const char close = object ? '}' : ']';
+            size_t p = skip_ws(begin + 1);
+            if (p < text.size() && text[p] == close) {
+                c->end = p + 1;
+                return c;
+            }
+            while (true) {
+                string key;
+                if (object) {
+                    if (p >= text.size() || text[p] != '"') fail(p, "expected a member name");
+                    const size_t key_end = skip_string(p);
+                    key = decode_string(p, key_end);
+                    p = skip_ws(key_end);
+                    if (p >= text.size() || text[p] != ':') fail(p, "expected ':'");
+                    p = skip_ws(p + 1);
+                }
+                const Node value{p, skip_value(p)};
+                if (object) c->members.insert_or_assign(std::move(key), value);
+                else c->elements.push_back(value);
+                p = skip_ws(value.end);
+                if (p < text.size() && text[p] == ',') {
+                    p = skip_ws(p + 1);
+                } else if (p < text.size() && text[p] == close) {
+                    c->end = p + 1;
+                    return c;
+                } else fail(p, object ? "expected ',' or '}'" : "expected ',' or ']'");
+            }
+        }
+
+        [[nodiscard]] const Container &container(const size_t begin) const {
+            {
+                shared_lock lock(mutex);
+                if (const auto it = containers.find(begin); it != containers.end()) return *it->second;
+            }
+            // scanned outside the lock; a concurrent scan of the same container gives the same table
+            auto scanned = scan_container(begin);
+            unique_lock lock(mutex);
+            return *containers.try_emplace(begin, std::move(scanned)).first->second;
+        }
+    };
+
+    LazyDocument::LazyDocument(shared_ptr<Impl> impl) : _impl(std::move(impl)) {
+        _impl->root_begin = _impl->skip_ws(0);
+        if (_impl->root_begin >= _impl->text.size()) Impl::fail(_impl->root_begin, "empty document");
+    }
+
+    LazyDocument LazyDocument::open(const string &path) {
+        auto impl = make_shared<Impl>();
+#ifdef JZ_LAZY_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw JZError(std::format("Cannot open JSON input '{}'", path), 0, 0);
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                impl->map = map;
+                impl->map_size = static_cast<size_t>(st.st_size);
+                impl->text = string_view(static_cast<const char *>(map), impl->map_size);
+            }
+        }
+        ::close(fd);
+#endif
+        if (!impl->map) {
+            // pipes, special files, failed mappings
+            ifstream in(path, ios::binary);
+            if (!in) throw JZError(std::format("Cannot read JSON input '{}'", path), 0, 0);
+            ostringstream buffer;
+            buffer << in.rdbuf();
+            impl->owned = std::move(buffer).str();
+            impl->text = impl->owned;
+        }
+        return LazyDocument(std::move(impl));
+    }
+
+    LazyDocument LazyDocument::from_string(string text) {
+        auto impl = make_shared<Impl>();
+        impl->owned = std::move(text);
+        impl->text = impl->owned;
+        return LazyDocument(std::move(impl));
+    }
+
+    LazyDocument::Node LazyDocument::root() const {
+        return Node{_impl->root_begin};
+    }
+
+    ordered_json::value_t LazyDocument::type(const Node node) const noexcept {
+        const string_view text = _impl->text;
+        switch (text[node.begin]) {
+            case '{': return ordered_json::value_t::object;
+            case '[': return ordered_json::value_t::array;
+            case '"': return ordered_json::value_t::string;
+            case 't':
+            case 'f': return ordered_json::value_t::boolean;
+            case 'n': return ordered_json::value_t::null;
+            default: {
+                // a number (anything else fails when materialized)
+                for (size_t p = node.begin; p < text.size() && p < node.end; ++p) {
+                    const char c = text[p];
+                    if (c == '.' || c == 'e' || c == 'E') return ordered_json::value_t::number_float;
+                    if (c != '-' && c != '+' && (c < '0' || c > '9')) break;
+                }
+                return text[node.begin] == '-'
+                           ? ordered_json::value_t::number_integer
+                           : ordered_json::value_t::number_unsigned;
+            }
+        }
+    }
+
+    optional<LazyDocument::Node> LazyDocument::member(const Node object, const string &key) const {
+        if (_impl->text[object.begin] != '{') return nullopt;
+        const Container &c = _impl->container(object.begin);
+        const auto it = c.members.find(key);
+        if (it == c.members.end()) return nullopt;
+        return it->second;
+    }
+
+    optional<LazyDocument::Node> LazyDocument::element(const Node array, const size_t index) const {
+        if (_impl->text[array.begin] != '[') return nullopt;
+        const Container &c = _impl->container(array.begin);
+        if (index >= c.elements.size()) return nullopt;
+        return c.elements[index];
+    }
+
+    const ordered_json &LazyDocument::materialize(const Node node) const {
+        {
+            shared_lock lock(_impl->mutex);
+            if (const auto it = _impl->values.find(node.begin); it != _impl->values.end()) return *it->second;
+        }
+        const size_t end = node.end != string_view::npos ? node.end : _impl->skip_value(node.begin);
+        unique_ptr<const ordered_json> value;
+        try {
+            value = make_unique<const ordered_json>(ordered_json::parse(_impl->text.substr(node.begin,
+                                                                                            end - node.begin)));
+        } catch (const exception &e) {
+            Impl::fail(node.begin, e.what());
+        }
+        unique_lock lock(_impl->mutex);
+        return *_impl->values.try_emplace(node.begin, std::move(value)).first->second;
+    }
+
+    string_view LazyDocument::text() const noexcept {
+        return _impl->text;
+    }
+} // namespace jz
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+namespace jz {
+    /*
+     LazyDocument
+     - JSON input read on demand (simdjson "on demand" style): the text, a memory-mapped file or a string, is
+       not parsed up front; looking up a member or element scans only the enclosing object/array once (nested
+       values are skipped with the structural scanner) and keeps its member table for later lookups
+     - a value is materialized into ordered_json only when it is used whole (emitted, compared, handed to a
+       tool), once: the result is kept for the lifetime of the document
+     - cheap to copy (shared state); lookups may run from several threads (parallel loops, render_batch)
+     - malformed JSON is reported (JZError) when the malformed part is read, not when the document is opened
+    */
+    class LazyDocument {
+    public:
+        // a value of the document: its extent in the text (end unknown until the value has been skipped)
+        struct Node {
+            size_t begin = 0;
+            size_t end = std::string_view::npos;
+        };
+
+        // memory-map a JSON file (read into memory when it cannot be mapped); throws JZError
+        static LazyDocument open(const std::string &path);
+
+        static LazyDocument from_string(std::string text);
+
+        [[nodiscard]] Node root() const;
+
+        // type of a value, from its first character (numbers: float, integer when negative, unsigned otherwise)
+        [[nodiscard]] nlohmann::ordered_json::value_t type(Node node) const noexcept;
+
+        // member of an object (the last one when the key is repeated, as ordered_json::parse keeps it)
+        [[nodiscard]] std::optional<Node> member(Node object, const std::string &key) const;
+
+        [[nodiscard]] std::optional<Node> element(Node array, size_t index) const;
+
+        // the value as ordered_json, parsed on first use
+        [[nodiscard]] const nlohmann::ordered_json &materialize(Node node) const;
+
+        [[nodiscard]] std::string_view text() const noexcept;
+
+    private:
+        struct Impl;
+
+        explicit LazyDocument(std::shared_ptr<Impl> impl);
+
+        std::shared_ptr<Impl> _impl;
+    };
+} // namespace jz
@@ -0,0 +1,106 @@
+#include "NdjsonBatch.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+using namespace std;
+
+namespace jz {
+    namespace {
+        /* Slot: one record of the reorder buffer
+           - input is set by the reader before the record is submitted; output/error/undefined by the worker,
+             published by `done` (guarded by the run mutex)
+        */
+        struct Slot {
+            size_t line = 0;
+            string input;
+            string output{};
+            string error{};
+            bool undefined = false;
+            bool done = false;
+        };
+    }
+
+    NdjsonStats render_ndjson(const CompiledTemplate &compiled, istream &in, ostream &out,
+                              const NdjsonOptions &options) {
+        ThreadPool &pool = options.pool ? *options.pool : ThreadPool::shared();
+        const size_t window = max<size_t>(options.window, 1);
+        vector<Slot> ring(window);
+        mutex done_mutex;
+        condition_variable done_cv;
+        NdjsonStats stats;
+        size_t head = 0, tail = 0; // records [head, tail) are in flight
+        const auto start = chrono::steady_clock::now();
+
+        const auto render = [&](Slot &slot) {
+            try {
+                const auto data = ordered_json::parse(slot.input);
+                json metadata = options.metadata;
+                if (auto j = compiled.render_optional(data, metadata)) slot.output = j->dump();
+                else slot.undefined = true;
+            } catch (const exception &e) {
+                slot.error = e.what();
+            } catch (...) {
+                slot.error = "unknown error";
+            }
+            // notified under the lock: once the reader sees the last record done, this frame may be gone
+            lock_guard lock(done_mutex);
+            slot.done = true;
+            done_cv.notify_all();
+        };
+
+        const auto wait_done = [&](const Slot &slot) {
+            unique_lock lock(done_mutex);
+            done_cv.wait(lock, [&slot] { return slot.done; });
+        };
+
+        // write out the oldest record once it is rendered
+        const auto retire = [&] {
+            const Slot &slot = ring[head % window];
+            wait_done(slot);
+            ++head;
+            if (!slot.error.empty()) {
+                ++stats.errors;
+                if (options.errors) *options.errors << "line " << slot.line << ": " << slot.error << '\n';
+            } else if (slot.undefined) {
+                ++stats.undefined;
+            } else {
+                out << slot.output << '\n';
+                stats.bytes_out += slot.output.size() + 1;
+                ++stats.written;
+            }
+        };
+
+        try {
+            string line;
+            size_t line_no = 0;
+            while (getline(in, line)) {
+                ++line_no;
+                stats.bytes_in += line.size() + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.find_first_not_of(" \t") == string::npos) continue;
+                if (tail - head == window) retire();
+                Slot &slot = ring[tail++ % window];
+                slot = Slot{line_no, std::move(line)};
+                ++stats.records;
+                pool.submit([&render, &slot] { render(slot); });
+            }
+            while (head < tail) retire();
+        } catch (...) {
+            // records still in flight use this frame: wait for them before leaving
+            for (; head < tail; ++head) wait_done(ring[head % window]);
+            throw;
+        }
+        out.flush();
+
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+} // namespace jz
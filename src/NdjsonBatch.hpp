@@ -0,0 +1,48 @@
+#pragma once
+
+#include "JZParser.hpp"
+
+#include <cstddef>
+#include <iosfwd>
+
+namespace jz {
+    class ThreadPool;
+
+    /* NdjsonOptions:
+       - window: records in flight at most (rendering or waiting for their turn in the reorder buffer)
+       - metadata: starting metadata of every record
+       - errors: where per-record error lines go ("line <n>: <message>"), none when null
+       - pool: worker pool, the shared one when null
+    */
+    struct NdjsonOptions {
+        size_t window = 1024;
+        json metadata;
+        std::ostream *errors = nullptr;
+        ThreadPool *pool = nullptr;
+    };
+
+    // counters of a render_ndjson run
+    struct NdjsonStats {
+        size_t records = 0; // non-empty input lines
+        size_t written = 0; // output lines
+        size_t undefined = 0; // records rendering to undefined (no output line)
+        size_t errors = 0; // records failing to parse or render (no output line)
+        size_t bytes_in = 0;
+        size_t bytes_out = 0;
+        double seconds = 0;
+
+        [[nodiscard]] double records_per_second() const noexcept { return seconds > 0 ? records / seconds : 0; }
+        [[nodiscard]] double mb_per_second() const noexcept { return seconds > 0 ? bytes_in / 1e6 / seconds : 0; }
+    };
+
+    /*
+     render_ndjson
+     - reads one JSON document per line from `in`, renders each with `compiled` on the worker pool and writes
+       the results to `out` as NDJSON, in input order
+     - records are held in a reorder buffer of options.window slots: reading waits for the oldest record
+       once the buffer is full, so memory stays bounded whatever the input size
+     - a failing record is reported on options.errors and left out; the run goes on
+    */
+    NdjsonStats render_ndjson(const CompiledTemplate &compiled, std::istream &in, std::ostream &out,
+                              const NdjsonOptions &options = {});
+} // namespace jz
@@ -0,0 +1,231 @@
+#include "RegexCache.hpp"
+
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+namespace jz {
+    /* -------------------------
+       Regex
+       ------------------------- */
+
+    // pattern of plain characters: its text and anchors; false when it needs a regex engine
+    static bool parse_literal(const string_view pattern, string &literal, bool &anchor_start, bool &anchor_end) {
+        size_t begin = 0, end = pattern.size();
+        if (begin < end && pattern[begin] == '^') {
+            anchor_start = true;
+            ++begin;
+        }
+        if (end > begin && pattern[end - 1] == '$') {
+            // anchor unless escaped (an odd number of backslashes before it)
+            size_t backslashes = 0;
+            while (end - 1 - backslashes > begin && pattern[end - 2 - backslashes] == '\\') ++backslashes;
+            if (backslashes % 2 == 0) {
+                anchor_end = true;
+                --end;
+            }
+        }
+        for (size_t i = begin; i < end; ++i) {
+            char c = pattern[i];
+            if (c == '\\') {
+                if (++i == end) return false;
+                c = pattern[i];
+                // \d, \w, \b, \1, \n, \u...: classes, assertions, back references and escapes need the engine
+                if (isalnum(static_cast<unsigned char>(c)) || static_cast<unsigned char>(c) >= 0x80) return false;
+            } else if (c == '\0' || strchr("^$.|?*+()[]{}", c)) {
+                return false;
+            }
+            literal += c;
+        }
+        return !literal.empty();
+    }
+
+    // counts a search or replacement and its time
+    class Regex::Timer {
+    public:
+        explicit Timer(const Regex &regex) noexcept : _regex(regex), _start(chrono::steady_clock::now()) {
+        }
+
+        ~Timer() {
+            const auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _start);
+            _regex._matches.fetch_add(1, memory_order_relaxed);
+            _regex._match_ns.fetch_add(static_cast<uint64_t>(elapsed.count()), memory_order_relaxed);
+        }
+
+        Timer(const Timer &) = delete;
+
+        Timer &operator=(const Timer &) = delete;
+
+    private:
+        const Regex &_regex;
+        chrono::steady_clock::time_point _start;
+    };
+
+    Regex::Regex(string pattern, string flags) : _pattern(std::move(pattern)), _flags(std::move(flags)) {
+        auto syntax = regex::ECMAScript;
+        for (const char f: _flags) {
+            if (f == 'i') syntax |= regex::icase;
+            else if (f == 'm') syntax |= regex::multiline;
+            else throw invalid_argument(std::format("unknown regular expression flag '{}'", f));
+        }
+        if (_flags.empty() && parse_literal(_pattern, _literal, _anchor_start, _anchor_end)) {
+            _engine = Engine::LITERAL;
+            return;
+        }
+        _literal.clear();
+        _anchor_start = _anchor_end = false;
+        _regex.emplace(_pattern, syntax);
+    }
+
+    const regex &Regex::std_regex() const {
+        call_once(_regex_once, [this] {
+            if (!_regex) _regex.emplace(_pattern, regex::ECMAScript);
+        });
+        return *_regex;
+    }
+
+    size_t Regex::find_literal(const string_view s, const size_t from) const noexcept {
+        if (_anchor_start) {
+            if (from > 0 || !s.starts_with(_literal)) return string_view::npos;
+            return !_anchor_end || s.size() == _literal.size() ? 0 : string_view::npos;
+        }
+        if (_anchor_end) {
+            if (!s.ends_with(_literal) || s.size() - _literal.size() < from) return string_view::npos;
+            return s.size() - _literal.size();
+        }
+        return s.find(_literal, from);
+    }
+
+    bool Regex::search(const string_view s) const {
+        Timer timer(*this);
+        if (_engine == Engine::LITERAL) return find_literal(s, 0) != string_view::npos;
+        return regex_search(s.data(), s.data() + s.size(), *_regex);
+    }
+
+    optional<string> Regex::extract(const string_view s, const size_t group) const {
+        if (group > groups()) throw invalid_argument(std::format("no group {} in the pattern", group));
+        Timer timer(*this);
+        if (_engine == Engine::LITERAL) {
+            if (find_literal(s, 0) == string_view::npos) return nullopt;
+            return _literal;
+        }
+        cmatch m;
+        if (!regex_search(s.data(), s.data() + s.size(), m, *_regex)) return nullopt;
+        return m[static_cast<int>(group)].str();
+    }
+
+    vector<string> Regex::extract_all(const string_view s, const size_t group) const {
+        if (group > groups()) throw invalid_argument(std::format("no group {} in the pattern", group));
+        Timer timer(*this);
+        vector<string> out;
+        if (_engine == Engine::LITERAL) {
+            for (size_t pos = find_literal(s, 0); pos != string_view::npos;
+                 pos = find_literal(s, pos + _literal.size()))
+                out.push_back(_literal);
+            return out;
+        }
+        for (cregex_iterator it(s.data(), s.data() + s.size(), *_regex), end; it != end; ++it)
+            out.push_back((*it)[static_cast<int>(group)].str());
+        return out;
+    }
+
+    string Regex::replace(const string_view s, const string_view format, const bool all) const {
+        Timer timer(*this);
+        string out;
+        // a format without '$' is the replacement text itself
+        if (_engine == Engine::LITERAL && format.find('$') == string_view::npos) {
+            size_t last = 0;
+            for (size_t pos = find_literal(s, 0); pos != string_view::npos;
+                 pos = all ? find_literal(s, last) : string_view::npos) {
+                out.append(s, last, pos - last).append(format);
+                last = pos + _literal.size();
+            }
+            out.append(s, last);
+            return out;
+        }
+        regex_replace(back_inserter(out), s.begin(), s.end(), std_regex(), string(format),
+                      all ? regex_constants::format_default : regex_constants::format_first_only);
+        return out;
+    }
+
+    /* -------------------------
+       RegexCache
+       ------------------------- */
+
+    RegexCache &RegexCache::instance() {
+        static RegexCache inst;
+        return inst;
+    }
+
+    void RegexCache::trim() {
+        while (_lru.size() > _capacity) {
+            _index.erase(_lru.back().key);
+            _lru.pop_back();
+            ++_evictions;
+        }
+    }
+
+    shared_ptr<const Regex> RegexCache::get(const string_view pattern, const string_view flags) {
+        // flags never hold '/', so the key separates them from the pattern
+        string key;
+        key.reserve(flags.size() + 1 + pattern.size());
+        key.append(flags).append(1, '/').append(pattern);
+        {
+            lock_guard lock(_mutex);
+            if (const auto it = _index.find(key); it != _index.end()) {
+                _lru.splice(_lru.begin(), _lru, it->second);
+                ++_hits;
+                return it->second->regex;
+            }
+            ++_misses;
+        }
+
+        // compile outside the lock: other threads keep using the cache meanwhile
+        auto compiled = make_shared<const Regex>(string(pattern), string(flags));
+
+        lock_guard lock(_mutex);
+        if (const auto it = _compiles.find(key); it != _compiles.end()) ++it->second;
+        else if (_compiles.size() < MAX_TRACKED_PATTERNS) _compiles.emplace(key, 1);
+        if (const auto it = _index.find(key); it != _index.end()) return it->second->regex; // inserted meanwhile
+        _lru.push_front(Entry{std::move(key), compiled});
+        _index.emplace(_lru.front().key, _lru.begin());
+        trim();
+        return compiled;
+    }
+
+    void RegexCache::set_capacity(const size_t capacity) {
+        lock_guard lock(_mutex);
+        _capacity = capacity;
+        trim();
+    }
+
+    void RegexCache::clear() {
+        lock_guard lock(_mutex);
+        _index.clear();
+        _lru.clear();
+    }
+
+    RegexCacheStats RegexCache::stats() const {
+        lock_guard lock(_mutex);
+        RegexCacheStats st;
+        st.hits = _hits;
+        st.misses = _misses;
+        st.evictions = _evictions;
+        st.entries = _lru.size();
+        st.capacity = _capacity;
+        for (const Entry &entry: _lru) {
+            const Regex &regex = *entry.regex;
+            const auto compiles = _compiles.find(entry.key);
+            st.patterns.push_back(RegexStats{
+                regex.pattern(), regex.flags(), regex.engine_name(),
+                compiles != _compiles.end() ? compiles->second : 1, regex.matches(), regex.match_ns()
+            });
+        }
+        return st;
+    }
+} // namespace jz
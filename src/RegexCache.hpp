@@ -0,0 +1,133 @@
+#pragma once
+
+#include "JZParser.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace jz {
+    /*
+     Regex
+     - a compiled pattern (ECMAScript syntax) and its flags: "i" (ignore case), "m" (^ and $ match at line breaks)
+     - a pattern of plain characters (metacharacters escaped with '\'), optionally anchored by ^ and $, without
+       flags, runs as a substring search: linear time, no backtracking and no std::regex
+     - the other patterns run on std::regex
+     - matching is on bytes, not code points: a non-ASCII character counts as several bytes ('.' matches one
+       of them, "i" folds ASCII letters only), e.g. "héllo" =~ "^h.l" is false
+     - immutable once built apart from its match counters: shared between templates and threads
+    */
+    class Regex {
+    public:
+        enum class Engine { LITERAL, STD };
+
+        // throws std::regex_error for an invalid pattern, std::invalid_argument for an unknown flag
+        Regex(std::string pattern, std::string flags);
+
+        [[nodiscard]] const std::string &pattern() const noexcept { return _pattern; }
+
+        [[nodiscard]] const std::string &flags() const noexcept { return _flags; }
+
+        [[nodiscard]] Engine engine() const noexcept { return _engine; }
+
+        [[nodiscard]] const char *engine_name() const noexcept {
+            return _engine == Engine::LITERAL ? "literal" : "std::regex";
+        }
+
+        // capture groups (none for literal patterns)
+        [[nodiscard]] size_t groups() const noexcept {
+            return _engine == Engine::LITERAL ? 0 : _regex->mark_count();
+        }
+
+        // whether s contains a match
+        [[nodiscard]] bool search(std::string_view s) const;
+
+        // text of a group (0: the whole match) of the first match; nullopt without a match
+        [[nodiscard]] std::optional<std::string> extract(std::string_view s, size_t group) const;
+
+        // text of a group of every match
+        [[nodiscard]] std::vector<std::string> extract_all(std::string_view s, size_t group) const;
+
+        // s with the first (or every) match replaced by format ($&, $1, ..., $$ as in ECMAScript)
+        [[nodiscard]] std::string replace(std::string_view s, std::string_view format, bool all) const;
+
+        [[nodiscard]] uint64_t matches() const noexcept { return _matches.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t match_ns() const noexcept { return _match_ns.load(std::memory_order_relaxed); }
+
+    private:
+        class Timer;
+
+        [[nodiscard]] const std::regex &std_regex() const;
+
+        // position of the first literal match at or after from (npos without one)
+        [[nodiscard]] size_t find_literal(std::string_view s, size_t from) const noexcept;
+
+        std::string _pattern;
+        std::string _flags;
+        Engine _engine = Engine::STD;
+        // literal engine
+        std::string _literal;
+        bool _anchor_start = false;
+        bool _anchor_end = false;
+        // std engine; literal patterns build it only for replacement formats with '$'
+        mutable std::optional<std::regex> _regex;
+        mutable std::once_flag _regex_once;
+        mutable std::atomic<uint64_t> _matches{0};
+        mutable std::atomic<uint64_t> _match_ns{0};
+    };
+
+    /*
+     RegexCache
+     - compiled regular expressions by pattern and flags, shared by the regex tools and the =~ operator
+     - bounded LRU (by entries) under a single lock; patterns are compiled outside of it
+     - a template holds the patterns it compiled, so an eviction only costs a later lookup a compile
+    */
+    class RegexCache {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = RegexCacheStats::DEFAULT_CAPACITY;
+        // patterns whose compile count is kept (after their eviction too)
+        static constexpr size_t MAX_TRACKED_PATTERNS = 4096;
+
+        static RegexCache &instance();
+
+        // compiled pattern; throws as Regex
+        std::shared_ptr<const Regex> get(std::string_view pattern, std::string_view flags = {});
+
+        // change the capacity, evicting what no longer fits
+        void set_capacity(size_t capacity);
+
+        // drop all entries (counters are kept)
+        void clear();
+
+        [[nodiscard]] RegexCacheStats stats() const;
+
+    private:
+        RegexCache() = default;
+
+        struct Entry {
+            std::string key;
+            std::shared_ptr<const Regex> regex;
+        };
+
+        // evict least recently used entries beyond the capacity (lock held)
+        void trim();
+
+        mutable std::mutex _mutex;
+        std::list<Entry> _lru; // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> _index; // keys point into Entry::key
+        std::unordered_map<std::string, uint64_t> _compiles; // by key
+        size_t _capacity = DEFAULT_CAPACITY;
+        uint64_t _hits = 0;
+        uint64_t _misses = 0;
+        uint64_t _evictions = 0;
+    };
+} // namespace jz
@@ -0,0 +1,108 @@
+#include "RenderArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+namespace jz {
+    atomic<bool> RenderArena::_report{false};
+
+    namespace {
+        /* ThreadArena: blocks filled in order; the position (block, offset) only moves forward while a scope
+           is open and is set back when it closes */
+        struct ThreadArena final : pmr::memory_resource {
+            struct Block {
+                unique_ptr<byte[]> data;
+                size_t size;
+            };
+
+            vector<Block> blocks;
+            size_t block = 0; // current block
+            size_t offset = 0; // in the current block
+            size_t depth = 0; // open scopes
+
+            // counters of the current render
+            size_t in_use = 0;
+            size_t peak = 0;
+            size_t requested = 0;
+            size_t heap_blocks = 0;
+
+            void *do_allocate(const size_t bytes, const size_t alignment) override {
+                requested += bytes;
+                while (true) {
+                    if (block == blocks.size()) {
+                        const size_t next = blocks.empty() ? RenderArena::INITIAL_BLOCK_SIZE : blocks.back().size * 2;
+                        const size_t size = max(next, bytes + alignment);
+                        blocks.push_back({make_unique_for_overwrite<byte[]>(size), size});
+                        ++heap_blocks;
+                    }
+                    const Block &b = blocks[block];
+                    const auto base = reinterpret_cast<uintptr_t>(b.data.get());
+                    const size_t start = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+                    if (start + bytes <= b.size) {
+                        in_use += start + bytes - offset;
+                        peak = max(peak, in_use);
+                        offset = start + bytes;
+                        return b.data.get() + start;
+                    }
+                    // the rest of this block stays unused until the position is set back before it
+                    in_use += b.size - offset;
+                    ++block;
+                    offset = 0;
+                    // a kept block too small for the request is replaced (with the ones after it)
+                    if (block < blocks.size() && blocks[block].size < bytes + alignment)
+                        blocks.erase(blocks.begin() + static_cast<ptrdiff_t>(block), blocks.end());
+                }
+            }
+
+            void do_deallocate(void *, size_t, size_t) override {
+            }
+
+            [[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override {
+                return this == &other;
+            }
+
+            // blocks beyond the budget are freed when the outermost scope closes
+            void trim() {
+                size_t kept = 0, n = 0;
+                while (n < blocks.size() && kept + blocks[n].size <= RenderArena::MAX_KEPT_BYTES)
+                    kept += blocks[n++].size;
+                blocks.erase(blocks.begin() + static_cast<ptrdiff_t>(n), blocks.end());
+            }
+        };
+
+        thread_local ThreadArena t_arena;
+    }
+
+    pmr::memory_resource *RenderArena::resource() noexcept {
+        return t_arena.depth ? static_cast<pmr::memory_resource *>(&t_arena) : pmr::get_default_resource();
+    }
+
+    RenderArena::Scope::Scope()
+        : _depth(t_arena.depth), _block(t_arena.block), _offset(t_arena.offset), _in_use(t_arena.in_use) {
+        if (_depth == 0) {
+            t_arena.in_use = t_arena.peak = t_arena.requested = t_arena.heap_blocks = 0;
+            _in_use = 0;
+        }
+        ++t_arena.depth;
+    }
+
+    RenderArena::Scope::~Scope() {
+        --t_arena.depth;
+        t_arena.block = _block;
+        t_arena.offset = _offset;
+        t_arena.in_use = _in_use;
+        if (_depth == 0) t_arena.trim();
+    }
+
+    void RenderArena::Scope::report(nlohmann::json &metadata) const {
+        if (_depth != 0 || !report_enabled()) return;
+        if (!metadata.is_null() && !metadata.is_object()) return;
+        metadata[REPORT_KEY] = {
+            {"bytes", t_arena.peak}, {"requested", t_arena.requested}, {"blocks", t_arena.heap_blocks}
+        };
+    }
+} // namespace jz
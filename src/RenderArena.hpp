@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <nlohmann/json.hpp>
+
+namespace jz {
+    /*
+     RenderArena
+     - per-thread bump arena backing the scratch memory of a render (scope layers of path lookups, spilled operand
+       stacks, parallel loop bookkeeping): allocations are pointer bumps, frees are no-ops, nothing goes through
+       the global allocator once the thread's blocks are large enough
+     - a render opens a Scope; scopes nest (tool blocks and loop items rendered inside a render) and each one
+       rewinds the arena to where it was opened when it closes, so a loop over many items reuses the same bytes
+       for every item; scratch memory must not outlive the scope it was allocated in
+     - the blocks are kept between renders (up to MAX_KEPT_BYTES), so a steady workload renders without heap
+       allocations; parallel loop items run on the arena of the thread rendering them
+     - outside a render, resource() is the default memory resource
+     - opt-in report: the memory used by a render is written to its metadata under REPORT_KEY
+    */
+    class RenderArena {
+    public:
+        static constexpr const char *REPORT_KEY = "$arena";
+        static constexpr size_t INITIAL_BLOCK_SIZE = 16 * 1024;
+        static constexpr size_t MAX_KEPT_BYTES = 4 * 1024 * 1024;
+
+        // memory resource of the current thread's render (the default resource when no render is open)
+        [[nodiscard]] static std::pmr::memory_resource *resource() noexcept;
+
+        class Scope {
+        public:
+            Scope();
+
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+
+            Scope &operator=(const Scope &) = delete;
+
+            [[nodiscard]] bool outermost() const noexcept { return _depth == 0; }
+
+            // when enabled and outermost: {"bytes": peak in use, "requested": total requested, "blocks": heap
+            // blocks allocated} of the render into metadata
+            void report(nlohmann::json &metadata) const;
+
+        private:
+            size_t _depth; // open scopes below this one
+            size_t _block; // arena position when opened
+            size_t _offset;
+            size_t _in_use;
+        };
+
+        static void set_report(const bool enabled) noexcept { _report.store(enabled, std::memory_order_relaxed); }
+
+        [[nodiscard]] static bool report_enabled() noexcept { return _report.load(std::memory_order_relaxed); }
+
+    private:
+        static std::atomic<bool> _report;
+    };
+} // namespace jz
@@ -0,0 +1,129 @@
+#include "StructuralScanner.hpp"
+
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JZ_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace jz {
+    /* -------------------------
+       Classification kernels
+       - p points to exactly 64 readable bytes (the tail of the input is copied into a zero-padded block)
+       ------------------------- */
+
+    using MaskKernel = uint64_t (*)(const char *p, const char *chars, size_t count, const bool *table);
+
+    static uint64_t mask_scalar(const char *p, const char *, size_t, const bool *table) {
+        uint64_t m = 0;
+        for (size_t i = 0; i < StructuralScanner::BLOCK; ++i) {
+            if (table[static_cast<unsigned char>(p[i])]) m |= uint64_t{1} << i;
+        }
+        return m;
+    }
+
+#ifdef JZ_SCANNER_X86
+    __attribute__((target("sse2")))
+    static uint64_t mask_sse2(const char *p, const char *chars, const size_t count, const bool *) {
+        uint64_t m = 0;
+        for (size_t off = 0; off < StructuralScanner::BLOCK; off += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + off));
+            __m128i acc = _mm_setzero_si128();
+            for (size_t k = 0; k < count; ++k) acc = _mm_or_si128(acc, _mm_cmpeq_epi8(v, _mm_set1_epi8(chars[k])));
+            m |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(acc))) << off;
+        }
+        return m;
+    }
+
+    __attribute__((target("avx2")))
+    static uint64_t mask_avx2(const char *p, const char *chars, const size_t count, const bool *) {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+        __m256i acc_lo = _mm256_setzero_si256();
+        __m256i acc_hi = _mm256_setzero_si256();
+        for (size_t k = 0; k < count; ++k) {
+            const __m256i needle = _mm256_set1_epi8(chars[k]);
+            acc_lo = _mm256_or_si256(acc_lo, _mm256_cmpeq_epi8(lo, needle));
+            acc_hi = _mm256_or_si256(acc_hi, _mm256_cmpeq_epi8(hi, needle));
+        }
+        return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(acc_lo))) |
+               static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(acc_hi))) << 32;
+    }
+#endif
+
+    struct KernelChoice {
+        MaskKernel fn;
+        const char *name;
+    };
+
+    static KernelChoice select_kernel() noexcept {
+#ifdef JZ_SCANNER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return {mask_avx2, "avx2"};
+        if (__builtin_cpu_supports("sse2")) return {mask_sse2, "sse2"};
+#endif
+        return {mask_scalar, "scalar"};
+    }
+
+    static const KernelChoice &kernel() noexcept {
+        static const KernelChoice choice = select_kernel();
+        return choice;
+    }
+
+    /* -------------------------
+       StructuralScanner
+       ------------------------- */
+
+    StructuralScanner::StructuralScanner(const string_view chars) {
+        if (chars.size() > MAX_CHARS)
+            throw invalid_argument("StructuralScanner: too many structural characters");
+        for (const char c: chars) {
+            if (c == '\0') throw invalid_argument("StructuralScanner: '\\0' cannot be a structural character");
+            _chars[_count++] = c;
+            _table[static_cast<unsigned char>(c)] = true;
+        }
+    }
+
+    const char *StructuralScanner::implementation() noexcept {
+        return kernel().name;
+    }
+
+    uint64_t StructuralScanner::block_mask(const string_view s, const size_t base) const noexcept {
+        if (base >= s.size()) return 0;
+        const size_t avail = s.size() - base;
+        if (avail >= BLOCK) return kernel().fn(s.data() + base, _chars.data(), _count, _table.data());
+
+        // tail: zero padding never matches since '\0' is not a structural character
+        char padded[BLOCK] = {};
+        memcpy(padded, s.data() + base, avail);
+        return kernel().fn(padded, _chars.data(), _count, _table.data());
+    }
+
+    size_t StructuralScanner::find(const string_view s, size_t from) const noexcept {
+        while (from < s.size()) {
+            if (const uint64_t m = block_mask(s, from)) return from + countr_zero(m);
+            from += BLOCK;
+        }
+        return s.size();
+    }
+
+    size_t StructuralScanner::Cursor::next(size_t from) noexcept {
+        if (from >= _s.size()) return _s.size();
+        if (_base != SIZE_MAX && from >= _base && from - _base < BLOCK) {
+            if (const uint64_t m = _mask & (~uint64_t{0} << (from - _base))) return _base + countr_zero(m);
+            from = _base + BLOCK;
+        }
+        while (from < _s.size()) {
+            _base = from;
+            _mask = _scanner.block_mask(_s, from);
+            if (_mask) return _base + countr_zero(_mask);
+            from += BLOCK;
+        }
+        return _s.size();
+    }
+} // namespace jz
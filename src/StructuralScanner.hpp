@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace jz {
+    /* StructuralScanner:
+       - classifies 64 bytes at a time against a small set of structural characters (quotes, backslash, '$', ...)
+         producing a 64-bit bitmap of their positions (like simdjson's stage 1)
+       - the kernel (AVX2, SSE2 or scalar) is chosen once at runtime from the CPU features
+       - the scanning loops use it to jump from one interesting byte to the next instead of testing every byte
+    */
+    class StructuralScanner {
+    public:
+        static constexpr size_t BLOCK = 64;
+        static constexpr size_t MAX_CHARS = 16;
+
+        // chars: the structural bytes (at most MAX_CHARS, '\0' not allowed)
+        explicit StructuralScanner(std::string_view chars);
+
+        // bitmap of the structural bytes in s[base, base + 64); bit i <-> s[base + i], bytes past the end are 0
+        [[nodiscard]] uint64_t block_mask(std::string_view s, size_t base) const noexcept;
+
+        // position of the first structural byte at or after from, or s.size()
+        [[nodiscard]] size_t find(std::string_view s, size_t from) const noexcept;
+
+        // name of the kernel selected for this CPU ("avx2", "sse2" or "scalar")
+        static const char *implementation() noexcept;
+
+        /* Cursor:
+           - walks the structural positions of one input, keeping the bitmap of the current block so that
+             consecutive calls inside the same 64 bytes do not classify them again
+        */
+        class Cursor {
+        public:
+            Cursor(const StructuralScanner &scanner, std::string_view s) noexcept : _scanner(scanner), _s(s) {
+            }
+
+            // position of the first structural byte at or after from, or the input size
+            size_t next(size_t from) noexcept;
+
+        private:
+            const StructuralScanner &_scanner;
+            std::string_view _s;
+            size_t _base = SIZE_MAX;
+            uint64_t _mask = 0;
+        };
+
+    private:
+        std::array<char, MAX_CHARS> _chars{};
+        size_t _count = 0;
+        std::array<bool, 256> _table{}; // membership table for the scalar kernel
+    };
+} // namespace jz
@@ -0,0 +1,101 @@
+#include "TemplateCache.hpp"
+
+#include <functional>
+
+using namespace std;
+
+namespace jz {
+    // bookkeeping of an entry besides the text and the compiled form (list node, index node)
+    static constexpr size_t ENTRY_OVERHEAD = 128;
+
+    TemplateCache &TemplateCache::instance() {
+        static TemplateCache inst;
+        return inst;
+    }
+
+    size_t TemplateCache::Shard::trim(const size_t budget) {
+        size_t evicted = 0;
+        while (bytes > budget && !lru.empty()) {
+            const Entry &victim = lru.back();
+            index.erase(Key{victim.hash, victim.text});
+            bytes -= victim.bytes;
+            lru.pop_back();
+            ++evicted;
+        }
+        return evicted;
+    }
+
+    void TemplateCache::enable(const size_t byte_budget) {
+        _byte_budget.store(byte_budget, memory_order_relaxed);
+        for (auto &shard: _shards) {
+            lock_guard lock(shard.mutex);
+            _evictions.fetch_add(shard.trim(byte_budget / SHARDS), memory_order_relaxed);
+        }
+        _enabled.store(true, memory_order_release);
+    }
+
+    void TemplateCache::disable() {
+        _enabled.store(false, memory_order_release);
+        clear();
+    }
+
+    void TemplateCache::clear() {
+        for (auto &shard: _shards) {
+            lock_guard lock(shard.mutex);
+            shard.index.clear();
+            shard.lru.clear();
+            shard.bytes = 0;
+        }
+    }
+
+    void TemplateCache::reset_stats() noexcept {
+        _hits.store(0, memory_order_relaxed);
+        _misses.store(0, memory_order_relaxed);
+        _evictions.store(0, memory_order_relaxed);
+    }
+
+    TemplateCacheStats TemplateCache::stats() const {
+        TemplateCacheStats st;
+        st.hits = _hits.load(memory_order_relaxed);
+        st.misses = _misses.load(memory_order_relaxed);
+        st.evictions = _evictions.load(memory_order_relaxed);
+        st.byte_budget = _byte_budget.load(memory_order_relaxed);
+        for (const auto &shard: _shards) {
+            lock_guard lock(shard.mutex);
+            st.entries += shard.lru.size();
+            st.bytes += shard.bytes;
+        }
+        return st;
+    }
+
+    CompiledTemplate TemplateCache::compile(const string_view jz_input) {
+        if (!enabled()) return Processor::compile(jz_input);
+
+        const size_t hash = std::hash<string_view>{}(jz_input);
+        Shard &shard = _shards[hash % SHARDS];
+        {
+            lock_guard lock(shard.mutex);
+            if (const auto it = shard.index.find(Key{hash, jz_input}); it != shard.index.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                _hits.fetch_add(1, memory_order_relaxed);
+                return it->second->compiled;
+            }
+        }
+        _misses.fetch_add(1, memory_order_relaxed);
+
+        // compile outside the lock: other threads keep using the shard meanwhile
+        CompiledTemplate compiled = Processor::compile(jz_input);
+        const size_t bytes = ENTRY_OVERHEAD + jz_input.size() + compiled.memory_size();
+        const size_t budget = shard_budget();
+        if (bytes > budget) return compiled; // would not fit even alone
+
+        lock_guard lock(shard.mutex);
+        if (shard.index.contains(Key{hash, jz_input})) return compiled; // inserted by another thread meanwhile
+        shard.lru.push_front(Entry{string(jz_input), hash, compiled, bytes});
+        const Entry &entry = shard.lru.front();
+        shard.index.emplace(Key{hash, entry.text}, shard.lru.begin());
+        shard.bytes += bytes;
+        _evictions.fetch_add(shard.trim(budget), memory_order_relaxed);
+        return compiled;
+    }
+} // namespace jz
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "JZParser.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace jz {
+    /*
+     TemplateCache
+     - opt-in cache of compiled templates for callers passing the same template text again and again:
+       Processor::to_json / to_string and the templates tools render through Processor (e.g. include) compile
+       through it; tool blocks are compiled along with their enclosing template
+     - keyed by a hash of the template text (the text itself is compared on lookup)
+     - sharded LRU: each shard has its own lock, recency list and index, and an even part of the byte budget;
+       the least recently used entries of a shard are evicted when it goes over its part
+     - disabled by default: compile then simply calls Processor::compile
+    */
+    class TemplateCache {
+    public:
+        static constexpr size_t SHARDS = 16;
+        static constexpr size_t DEFAULT_BYTE_BUDGET = TemplateCacheStats::DEFAULT_BYTE_BUDGET;
+
+        static TemplateCache &instance();
+
+        // enable the cache (or change its budget, evicting what no longer fits)
+        void enable(size_t byte_budget = DEFAULT_BYTE_BUDGET);
+
+        // disable the cache and drop its entries (counters are kept)
+        void disable();
+
+        [[nodiscard]] bool enabled() const noexcept { return _enabled.load(std::memory_order_acquire); }
+
+        // compiled template for jz_input, from the cache when enabled; throws JZError on parse errors
+        CompiledTemplate compile(std::string_view jz_input);
+
+        // drop all entries
+        void clear();
+
+        // reset hit/miss/eviction counters
+        void reset_stats() noexcept;
+
+        [[nodiscard]] TemplateCacheStats stats() const;
+
+    private:
+        TemplateCache() = default;
+
+        struct Entry {
+            std::string text;
+            size_t hash;
+            CompiledTemplate compiled;
+            size_t bytes;
+        };
+
+        struct Key {
+            size_t hash;
+            std::string_view text; // points into Entry::text
+
+            bool operator==(const Key &other) const noexcept { return hash == other.hash && text == other.text; }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key &k) const noexcept { return k.hash; }
+        };
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::list<Entry> lru; // most recently used first
+            std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+            size_t bytes = 0;
+
+            // evict least recently used entries until bytes <= budget; returns the number evicted
+            size_t trim(size_t budget);
+        };
+
+        [[nodiscard]] size_t shard_budget() const noexcept {
+            return _byte_budget.load(std::memory_order_relaxed) / SHARDS;
+        }
+
+        std::array<Shard, SHARDS> _shards;
+        std::atomic<bool> _enabled{false};
+        std::atomic<size_t> _byte_budget{DEFAULT_BYTE_BUDGET};
+        std::atomic<uint64_t> _hits{0};
+        std::atomic<uint64_t> _misses{0};
+        std::atomic<uint64_t> _evictions{0};
+    };
+} // namespace jz
@@ -0,0 +1,145 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+using namespace std;
+
+namespace jz {
+    // pool and queue index of the current worker thread
+    static thread_local const ThreadPool *t_pool = nullptr;
+    static thread_local size_t t_index = 0;
+
+    ThreadPool::ThreadPool(const size_t workers) {
+        for (size_t i = 0; i <= workers; ++i) _queues.push_back(make_unique<Queue>());
+        _threads.reserve(workers);
+        for (size_t i = 0; i < workers; ++i) _threads.emplace_back([this, i] { worker_loop(i); });
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            lock_guard lock(_wake_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto &t: _threads) t.join();
+    }
+
+    ThreadPool &ThreadPool::shared() {
+        static ThreadPool pool(max(2u, thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    size_t ThreadPool::home_queue() const noexcept {
+        return t_pool == this ? t_index : _queues.size() - 1;
+    }
+
+    bool ThreadPool::run_one(const size_t home) {
+        Task task;
+        // own queue: newest first (cache warm), other queues: oldest first (largest remaining work)
+        {
+            Queue &q = *_queues[home];
+            lock_guard lock(q.mutex);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+        }
+        for (size_t k = 1; !task && k < _queues.size(); ++k) {
+            Queue &q = *_queues[(home + k) % _queues.size()];
+            lock_guard lock(q.mutex);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        _queued.fetch_sub(1, memory_order_relaxed);
+        task();
+        return true;
+    }
+
+    void ThreadPool::worker_loop(const size_t index) {
+        t_pool = this;
+        t_index = index;
+        while (true) {
+            if (run_one(index)) continue;
+            unique_lock lock(_wake_mutex);
+            _wake.wait(lock, [this] { return _stop || _queued.load(memory_order_relaxed) > 0; });
+            if (_stop) return;
+        }
+    }
+
+    void ThreadPool::submit(Task task) {
+        if (_threads.empty()) {
+            task();
+            return;
+        }
+        {
+            // counted under the queue lock, before a worker can take the task (and count it out)
+            Queue &q = *_queues[home_queue()];
+            lock_guard lock(q.mutex);
+            _queued.fetch_add(1, memory_order_relaxed);
+            q.tasks.push_back(std::move(task));
+        }
+        {
+            lock_guard lock(_wake_mutex);
+        }
+        _wake.notify_one();
+    }
+
+    void ThreadPool::parallel_for(const size_t count, const function<void(size_t)> &fn) {
+        if (count == 0) return;
+        if (count == 1 || _threads.empty()) {
+            for (size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        struct Group {
+            atomic<size_t> remaining;
+            mutex state_mutex; // error; the last chunk counts itself out and notifies under it
+            condition_variable done;
+            exception_ptr error;
+        } group;
+
+        // a few chunks per thread: balances uneven items, stealing takes care of the rest
+        const size_t chunks = min(count, (_threads.size() + 1) * 4);
+        group.remaining.store(chunks, memory_order_relaxed);
+
+        const size_t home = home_queue();
+        {
+            Queue &q = *_queues[home];
+            lock_guard lock(q.mutex);
+            _queued.fetch_add(chunks, memory_order_relaxed);
+            for (size_t c = 0; c < chunks; ++c) {
+                const size_t begin = c * count / chunks;
+                const size_t end = (c + 1) * count / chunks;
+                q.tasks.emplace_back([&group, &fn, begin, end] {
+                    try {
+                        for (size_t i = begin; i < end; ++i) fn(i);
+                    } catch (...) {
+                        lock_guard error_lock(group.state_mutex);
+                        if (!group.error) group.error = current_exception();
+                    }
+                    lock_guard done_lock(group.state_mutex);
+                    if (group.remaining.fetch_sub(1, memory_order_release) == 1) group.done.notify_all();
+                });
+            }
+        }
+        {
+            lock_guard lock(_wake_mutex);
+        }
+        _wake.notify_all();
+
+        // help until no task is left to take (running other groups' tasks meanwhile is fine), then sleep until
+        // the chunks still running end
+        while (group.remaining.load(memory_order_acquire) > 0) {
+            if (run_one(home)) continue;
+            unique_lock lock(group.state_mutex);
+            group.done.wait(lock, [&group] { return group.remaining.load(memory_order_acquire) == 0; });
+        }
+        // the last chunk may still hold the lock: group must outlive it
+        lock_guard lock(group.state_mutex);
+        if (group.error) rethrow_exception(group.error);
+    }
+} // namespace jz
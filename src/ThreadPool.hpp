@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jz {
+    /*
+     ThreadPool
+     - work-stealing pool: each worker has its own task deque (own tasks taken LIFO, others' stolen FIFO),
+       threads outside the pool submit to a shared queue
+     - parallel_for splits an index range into chunks; the calling thread runs chunks too while it waits, so
+       nested parallel_for calls (a parallel loop inside a parallel loop) cannot starve the pool; once no task
+       is left to take it sleeps until the running chunks end
+     - shared() is the process-wide pool used by the parallel loops and batch rendering
+    */
+    class ThreadPool {
+    public:
+        // workers: number of threads besides the callers
+        explicit ThreadPool(size_t workers);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // process-wide pool (hardware threads - 1 workers, at least 1)
+        static ThreadPool &shared();
+
+        [[nodiscard]] size_t workers() const noexcept { return _threads.size(); }
+
+        // run fn(i) for every i in [0, count), returns when all are done; the first exception thrown by fn
+        // (in completion order) is rethrown
+        void parallel_for(size_t count, const std::function<void(size_t)> &fn);
+
+        using Task = std::function<void()>;
+
+        // run a task asynchronously; it must not throw, and the caller waits for it by its own means
+        void submit(Task task);
+
+    private:
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void worker_loop(size_t index);
+
+        // run one task: from the home queue first, then stolen from the others; false when all are empty
+        bool run_one(size_t home);
+
+        // home queue of the calling thread (its own deque for workers, the shared queue otherwise)
+        [[nodiscard]] size_t home_queue() const noexcept;
+
+        std::vector<std::unique_ptr<Queue>> _queues; // one per worker, then the shared submission queue
+        std::vector<std::thread> _threads;
+        std::atomic<size_t> _queued{0};
+        std::mutex _wake_mutex;
+        std::condition_variable _wake;
+        bool _stop = false;
+    };
+} // namespace jz
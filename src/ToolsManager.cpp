@@ -7,6 +7,7 @@
 #include <locale>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
 #include <iostream>
 
 #include "tools/TemplateTools.hpp"
@@ -23,35 +24,118 @@ ToolsManager &ToolsManager::instance() {
         DateTools::init();
         TemplateTools::init();
         StringTools::init();
+        inst.freeze();
     }
     return inst;
 }
 
 void ToolsManager::register_tool(const std::string &name, ToolFunction fn) {
-    unique_lock locker(_registryMutex);
-    _registry[name] = std::move(fn);
+    register_entry(name, Tool{std::move(fn), nullptr, nullptr});
 }
 
 void ToolsManager::register_tool(const std::string &name, const std::shared_ptr<ToolObject> &tool) {
-    std::unique_lock locker(_registryMutex);
-    _registry[name] = [tool](const ordered_json &input, const ordered_json &options,
-                             const ordered_json &ctx, json &metadata) mutable {
-        return (*tool)(input, options, ctx, metadata);
-    };
+    register_entry(name, Tool{
+                       [tool](const ordered_json &input, const ordered_json &options,
+                              const ordered_json &ctx, json &metadata) mutable {
+                           return (*tool)(input, options, ctx, metadata);
+                       },
+                       nullptr, nullptr
+                   });
 }
 
-ordered_json ToolsManager::run_tool(const std::string &name, const ordered_json &input, const ordered_json &options,
-                                    const ordered_json &ctx, json &metadata) {
+void ToolsManager::register_entry(const std::string &name, Tool tool) {
+    unique_lock locker(_registryMutex);
+    const Tool *stored = _tools.emplace_back(std::make_unique<const Tool>(std::move(tool))).get();
+
+    const Registry *snapshot = _snapshot.load(memory_order_relaxed);
+    const Registry &current = snapshot ? *snapshot : _registry;
+    if (const auto it = current.find(name); it != current.end()) {
+        // registered again: swap the tool in place (the previous one may still be running)
+        it->second->tool.store(stored, memory_order_release);
+        return;
+    }
+
+    Slot *slot = _slots.emplace_back(std::make_unique<Slot>()).get();
+    slot->tool.store(stored, memory_order_relaxed);
+    if (!snapshot) {
+        _registry.emplace(name, slot);
+        return;
+    }
+    // frozen: publish a copy including the new tool
+    auto next = std::make_unique<Registry>(*snapshot);
+    next->emplace(name, slot);
+    _snapshot.store(next.get(), memory_order_release);
+    _snapshots.push_back(std::move(next));
+}
+
+void ToolsManager::freeze() {
+    unique_lock locker(_registryMutex);
+    if (_snapshot.load(memory_order_relaxed)) return;
+    auto snapshot = std::make_unique<const Registry>(_registry);
+    _snapshot.store(snapshot.get(), memory_order_release);
+    _snapshots.push_back(std::move(snapshot));
+}
+
+const ToolsManager::Slot *ToolsManager::find_slot(const std::string &name) {
+    if (const Registry *snapshot = _snapshot.load(memory_order_acquire)) {
+        const auto it = snapshot->find(name);
+        return it == snapshot->end() ? nullptr : it->second;
+    }
     shared_lock locker(_registryMutex);
     const auto it = _registry.find(name);
-    if (it == _registry.end()) {
+    return it == _registry.end() ? nullptr : it->second;
+}
+
+ordered_json ToolsManager::run_tool(const std::string &name, const ordered_json &input, const ordered_json &options,
+                                    const ordered_json &ctx, json &metadata) {
+    const Slot *slot = find_slot(name);
+    if (!slot) {
         throw std::runtime_error("Unknown tool: " + name);
     }
-    return it->second(input, options, ctx, metadata);
+    return slot->tool.load(memory_order_acquire)->fn(input, options, ctx, metadata);
 }
 
 bool ToolsManager::has_tool(const std::string &name) {
-    shared_lock locker(_registryMutex);
-    return _registry.contains(name);
+    return find_slot(name) != nullptr;
+}
+
+ToolsManager::ToolHandle ToolsManager::resolve(const std::string &name) {
+    return ToolHandle(find_slot(name));
+}
+
+ordered_json ToolsManager::ToolHandle::operator()(const ordered_json &input, const ordered_json &options,
+                                                  const ordered_json &ctx, json &metadata) const {
+    return _slot->tool.load(memory_order_acquire)->fn(input, options, ctx, metadata);
+}
+
+ordered_json ToolsManager::ToolHandle::operator()(const ordered_json &input, const ordered_json &options,
+                                                  const PreparedOptions &prepared, const ordered_json &ctx,
+                                                  json &metadata) const {
+    const Tool *tool = _slot->tool.load(memory_order_acquire);
+    if (prepared._options && prepared._tool == tool) return tool->bound(input, *prepared._options, ctx, metadata);
+    return tool->fn(input, options, ctx, metadata);
+}
+
+ordered_json ToolsManager::ToolHandle::operator()(ordered_json &&input, const ordered_json &options,
+                                                  const PreparedOptions &prepared, const ordered_json &ctx,
+                                                  json &metadata) const {
+    const Tool *tool = _slot->tool.load(memory_order_acquire);
+    if (!tool->fn_owned) return (*this)(std::as_const(input), options, prepared, ctx, metadata);
+    if (prepared._options && prepared._tool == tool)
+        return tool->bound_owned(std::move(input), *prepared._options, ctx, metadata);
+    return tool->fn_owned(std::move(input), options, ctx, metadata);
+}
+
+ToolsManager::PreparedOptions ToolsManager::ToolHandle::prepare(const ordered_json &options) const {
+    PreparedOptions prepared;
+    const Tool *tool = _slot ? _slot->tool.load(memory_order_acquire) : nullptr;
+    if (!tool || !tool->bind) return prepared;
+    try {
+        prepared._options = tool->bind(options);
+        prepared._tool = tool;
+    } catch (...) {
+        // reported by the call, which parses the options again
+    }
+    return prepared;
 }
 
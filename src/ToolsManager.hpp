@@ -1,8 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <concepts>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -16,8 +23,99 @@ namespace jz {
     using ToolFunction = std::function<ordered_json(const ordered_json &input, const ordered_json &options,
                                                     const ordered_json &ctx, json &metadata)>;
 
+    // Typed options of a tool: a tool registered with an options type (derived from ToolOptions, explicitly
+    // constructible from the options object) receives them parsed once per call instead of the options object;
+    // constant options of a compiled call are parsed once, when the template is compiled (see prepare).
+    struct ToolOptions {
+        virtual ~ToolOptions() = default;
+
+        // Options the untyped tool only read once the input reached them: parse them with deferred(), which
+        // keeps what parsing throws, and rethrow() it where they are used, so that a malformed option fails
+        // only for the inputs it failed for before.
+        template<typename Parse>
+        static std::exception_ptr deferred(Parse &&parse) noexcept {
+            try {
+                parse();
+                return nullptr;
+            } catch (...) {
+                return std::current_exception();
+            }
+        }
+
+        static void rethrow(const std::exception_ptr &error) {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+
+    template<typename Options>
+    using TypedToolFunction = ordered_json (*)(const ordered_json &input, const Options &options,
+                                               const ordered_json &ctx, json &metadata);
+
+    // Tool taking ownership of its input, so that it can build the result in place: it is moved the input when
+    // the caller owns it (e.g. the result of the previous pipeline step) and passed a copy otherwise.
+    template<typename Options>
+    using OwnedToolFunction = ordered_json (*)(ordered_json &&input, const Options &options,
+                                               const ordered_json &ctx, json &metadata);
+
+    /*
+     ToolsManager
+     - registry of the tools callable from pipelines (name -> ToolFunction)
+     - freeze() (done once the built-in tools are registered) publishes an immutable snapshot of the registry:
+       lookups then read it without any lock; later registrations copy it, add the tool and publish the copy
+       (RCU style: replaced snapshots and functions are retired, not freed, since readers may still use them)
+     - resolve() returns a ToolHandle bound to the tool slot: calling it does no lookup and takes no lock, and
+       still sees a tool registered again under the same name
+    */
     class ToolsManager {
+        struct Slot;
+        struct Tool;
+
     public:
+        // options parsed for a tool ahead of its calls (ToolHandle::prepare); empty when the tool has no options
+        // type or they did not parse. Used only while the tool they were parsed for is the registered one.
+        class PreparedOptions {
+        public:
+            PreparedOptions() = default;
+
+            explicit operator bool() const noexcept { return _options != nullptr; }
+
+        private:
+            friend class ToolsManager;
+
+            const Tool *_tool = nullptr;
+            std::shared_ptr<const ToolOptions> _options;
+        };
+
+        class ToolHandle {
+        public:
+            ToolHandle() = default;
+
+            // false when the tool was not registered at resolve time
+            explicit operator bool() const noexcept { return _slot != nullptr; }
+
+            ordered_json operator()(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+                                    json &metadata) const;
+
+            // call with options prepared from `options` (the options object is used when they no longer apply)
+            ordered_json operator()(const ordered_json &input, const ordered_json &options,
+                                    const PreparedOptions &prepared, const ordered_json &ctx, json &metadata) const;
+
+            // same, giving up the input: moved to tools taking ownership of it (see OwnedToolFunction)
+            ordered_json operator()(ordered_json &&input, const ordered_json &options,
+                                    const PreparedOptions &prepared, const ordered_json &ctx, json &metadata) const;
+
+            // parse `options` into the tool's options type (never throws: errors surface when it is called)
+            [[nodiscard]] PreparedOptions prepare(const ordered_json &options) const;
+
+        private:
+            friend class ToolsManager;
+
+            explicit ToolHandle(const Slot *slot) noexcept : _slot(slot) {
+            }
+
+            const Slot *_slot = nullptr;
+        };
+
         class ToolObject {
         public:
             virtual ~ToolObject() = default;
@@ -33,6 +131,52 @@ namespace jz {
 
         void register_tool(const std::string &name, const std::shared_ptr<ToolObject> &tool);
 
+        // tool with typed options (see ToolOptions)
+        template<std::derived_from<ToolOptions> Options>
+            requires std::constructible_from<Options, const ordered_json &>
+        void register_tool(const std::string &name, const TypedToolFunction<Options> fn) {
+            Tool tool;
+            tool.fn = [fn](const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+                           json &metadata) {
+                return fn(input, Options(options), ctx, metadata);
+            };
+            tool.bind = [](const ordered_json &options) -> std::shared_ptr<const ToolOptions> {
+                return std::make_shared<const Options>(options);
+            };
+            tool.bound = [fn](const ordered_json &input, const ToolOptions &options, const ordered_json &ctx,
+                              json &metadata) {
+                return fn(input, static_cast<const Options &>(options), ctx, metadata);
+            };
+            register_entry(name, std::move(tool));
+        }
+
+        // tool with typed options taking ownership of its input (see OwnedToolFunction)
+        template<std::derived_from<ToolOptions> Options>
+            requires std::constructible_from<Options, const ordered_json &>
+        void register_tool(const std::string &name, const OwnedToolFunction<Options> fn) {
+            Tool tool;
+            tool.fn = [fn](const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+                           json &metadata) {
+                return fn(ordered_json(input), Options(options), ctx, metadata);
+            };
+            tool.bind = [](const ordered_json &options) -> std::shared_ptr<const ToolOptions> {
+                return std::make_shared<const Options>(options);
+            };
+            tool.bound = [fn](const ordered_json &input, const ToolOptions &options, const ordered_json &ctx,
+                              json &metadata) {
+                return fn(ordered_json(input), static_cast<const Options &>(options), ctx, metadata);
+            };
+            tool.fn_owned = [fn](ordered_json &&input, const ordered_json &options, const ordered_json &ctx,
+                                 json &metadata) {
+                return fn(std::move(input), Options(options), ctx, metadata);
+            };
+            tool.bound_owned = [fn](ordered_json &&input, const ToolOptions &options, const ordered_json &ctx,
+                                    json &metadata) {
+                return fn(std::move(input), static_cast<const Options &>(options), ctx, metadata);
+            };
+            register_entry(name, std::move(tool));
+        }
+
         // run a registered tool; throws if not found
         ordered_json run_tool(const std::string &name, const ordered_json &input, const ordered_json &options,
                               const ordered_json &ctx, json &metadata);
@@ -40,6 +184,12 @@ namespace jz {
         // check exists
         bool has_tool(const std::string &name);
 
+        // handle of a registered tool (empty handle when not registered)
+        ToolHandle resolve(const std::string &name);
+
+        // publish the registry as an immutable snapshot read without locking (later registrations stay possible)
+        void freeze();
+
         template<typename T>
         static T get_option(const ordered_json &options, const std::string &name, const T &defaultValue) {
             if (options.is_object() && options.contains(name))
@@ -54,11 +204,39 @@ namespace jz {
         }
 
     private:
+        struct Tool {
+            ToolFunction fn{};
+            // typed options: parse the options object, call with parsed options
+            std::function<std::shared_ptr<const ToolOptions>(const ordered_json &options)> bind{};
+            std::function<ordered_json(const ordered_json &input, const ToolOptions &options, const ordered_json &ctx,
+                                       json &metadata)> bound{};
+            // owned input: same calls, moving the input to the tool (empty: the tool only borrows its input)
+            std::function<ordered_json(ordered_json &&input, const ordered_json &options, const ordered_json &ctx,
+                                       json &metadata)> fn_owned{};
+            std::function<ordered_json(ordered_json &&input, const ToolOptions &options, const ordered_json &ctx,
+                                       json &metadata)> bound_owned{};
+        };
+
+        struct Slot {
+            std::atomic<const Tool *> tool;
+        };
+
+        using Registry = std::unordered_map<std::string, Slot *>;
+
         ToolsManager() = default;
 
         ~ToolsManager() = default;
 
-        std::unordered_map<std::string, ToolFunction> _registry;
-        std::shared_mutex _registryMutex;
+        [[nodiscard]] const Slot *find_slot(const std::string &name);
+
+        void register_entry(const std::string &name, Tool tool);
+
+        Registry _registry; // before freeze (guarded by _registryMutex)
+        std::atomic<const Registry *> _snapshot{nullptr}; // after freeze
+        std::shared_mutex _registryMutex; // registrations, and lookups before freeze
+        // owned storage: slots, tools and snapshots are never freed while the manager lives
+        std::vector<std::unique_ptr<Slot>> _slots;
+        std::vector<std::unique_ptr<const Tool>> _tools;
+        std::vector<std::unique_ptr<const Registry>> _snapshots;
     };
 } // namespace jz
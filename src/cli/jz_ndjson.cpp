@@ -0,0 +1,97 @@
+/*
+ jz-ndjson: render NDJSON records (one JSON document per line) through a JZ template
+ usage: jz-ndjson <template.jz> [input.ndjson|-] [-o output.ndjson] [-w window] [-t threads] [-q]
+ - records are rendered in parallel and written in input order; failing records are reported on stderr
+ - a summary (records/s, MB/s, errors) is printed on stderr unless -q
+*/
+#include "../JZParser.hpp"
+#include "../NdjsonBatch.hpp"
+#include "../ThreadPool.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace jz;
+
+static int usage() {
+    std::cerr << "usage: jz-ndjson <template.jz> [input.ndjson|-] [-o output.ndjson] [-w window] [-t threads] [-q]\n";
+    return 2;
+}
+
+int main(const int argc, char **argv) {
+    std::string template_path, input_path = "-", output_path = "-";
+    NdjsonOptions options;
+    size_t threads = 0;
+    bool quiet = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if ((arg == "-o" || arg == "-w" || arg == "-t") && i + 1 < argc) {
+            const char *value = argv[++i];
+            if (arg == "-o") output_path = value;
+            else if (arg == "-w") options.window = std::strtoul(value, nullptr, 10);
+            else threads = std::strtoul(value, nullptr, 10);
+        } else if (arg == "-q") quiet = true;
+        else if (!arg.empty() && arg[0] == '-' && arg != "-") return usage();
+        else if (template_path.empty()) template_path = arg;
+        else input_path = arg;
+    }
+    if (template_path.empty()) return usage();
+
+    std::ifstream template_file(template_path);
+    if (!template_file) {
+        std::cerr << "jz-ndjson: cannot read " << template_path << '\n';
+        return 1;
+    }
+    std::stringstream template_text;
+    template_text << template_file.rdbuf();
+
+    std::ifstream input_file;
+    if (input_path != "-") {
+        input_file.open(input_path);
+        if (!input_file) {
+            std::cerr << "jz-ndjson: cannot read " << input_path << '\n';
+            return 1;
+        }
+    }
+    std::ofstream output_file;
+    if (output_path != "-") {
+        output_file.open(output_path);
+        if (!output_file) {
+            std::cerr << "jz-ndjson: cannot write " << output_path << '\n';
+            return 1;
+        }
+    }
+    std::istream &in = input_path != "-" ? static_cast<std::istream &>(input_file) : std::cin;
+    std::ostream &out = output_path != "-" ? static_cast<std::ostream &>(output_file) : std::cout;
+    std::ios::sync_with_stdio(false);
+
+    // -t: threads rendering besides the reader (the shared pool otherwise)
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 0) {
+        pool = std::make_unique<ThreadPool>(threads);
+        options.pool = pool.get();
+    }
+    options.errors = &std::cerr;
+
+    try {
+        const CompiledTemplate compiled = Processor::compile(template_text.str());
+        const NdjsonStats stats = render_ndjson(compiled, in, out, options);
+        if (!quiet) {
+            std::cerr << "jz-ndjson: " << stats.records << " records (" << stats.written << " written, "
+                    << stats.undefined << " undefined, " << stats.errors << " errors) in " << stats.seconds
+                    << " s: " << stats.records_per_second() << " records/s, " << stats.mb_per_second()
+                    << " MB/s\n";
+        }
+        return stats.errors ? 1 : 0;
+    } catch (const JZError &e) {
+        std::cerr << "jz-ndjson: " << template_path << ':' << e.line() << ':' << e.column() << ": " << e.what()
+                << '\n';
+    } catch (const std::exception &e) {
+        std::cerr << "jz-ndjson: " << e.what() << '\n';
+    }
+    return 1;
+}
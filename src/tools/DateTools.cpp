@@ -15,6 +15,13 @@ void DateTools::init() {
     tm.register_tool("millis", millis);
 }
 
+DateTools::DateFormatOptions::DateFormatOptions(const ordered_json &options) {
+    error = deferred([&] {
+        format = std::format("{{:{}}}", ToolsManager::get_option(options, "fmt", string("%Y-%m-%dT%H:%M:%SZ")));
+        precision = ToolsManager::get_option(options, "precision", string("seconds"));
+    });
+}
+
 /**
  * Format a date given in milliseconds since epoch.
  *
@@ -25,8 +32,8 @@ void DateTools::init() {
  * @param metadata Metadata (not used in this function).
  * @return The formatted date string.
  */
-ordered_json DateTools::dateFormat(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
-                                   json &metadata) {
+ordered_json DateTools::dateFormat(const ordered_json &input, const DateFormatOptions &options,
+                                   const ordered_json &ctx, json &metadata) {
     // input
     long long millis_since_epoch = 0;
     if (input.is_number_integer() || input.is_number_unsigned()) {
@@ -39,11 +46,10 @@ ordered_json DateTools::dateFormat(const ordered_json &input, const ordered_json
         return nullptr;
     }
 
-    // options
-    const string fmt = ToolsManager::get_option(options, "fmt", string("%Y-%m-%dT%H:%M:%SZ"));
-    const string precision = ToolsManager::get_option(options, "precision", string("seconds"));
-
-    const string &f = std::format("{{:{}}}", fmt);
+    // options (parsed once per call, or once per template when constant)
+    ToolOptions::rethrow(options.error);
+    const string &precision = options.precision;
+    const string &f = options.format;
 
     // Build time_point from milliseconds
     const milliseconds ms{millis_since_epoch};
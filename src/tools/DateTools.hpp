@@ -1,5 +1,8 @@
 #pragma once
 #include <nlohmann/json_fwd.hpp>
+#include <string>
+
+#include "../ToolsManager.hpp"
 
 using ordered_json = nlohmann::ordered_json;
 
@@ -10,8 +13,16 @@ class DateTools
 public:
 	static void init();
 
+	struct DateFormatOptions : ToolOptions {
+		std::string format; // "{:<fmt>}", ready for std::vformat
+		std::string precision;
+		std::exception_ptr error; // fmt / precision: read once the input is a date
+
+		explicit DateFormatOptions(const ordered_json& options);
+	};
+
 private:
-	static ordered_json dateFormat(const ordered_json& input,const ordered_json& options,const ordered_json& ctx, json &metadata);
+	static ordered_json dateFormat(const ordered_json& input,const DateFormatOptions& options,const ordered_json& ctx, json &metadata);
 
     static ordered_json millis(const ordered_json &input, const ordered_json &options, const ordered_json &ctx, json &metadata);
 };
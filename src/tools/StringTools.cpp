@@ -1,9 +1,14 @@
 #include "StringTools.hpp"
+#include "TextTransform.hpp"
 #include "../ToolsManager.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <format>
 #include <sstream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 using namespace std;
 using namespace jz;
@@ -15,52 +20,164 @@ void StringTools::init() {
     tm.register_tool("lower", lower);
     tm.register_tool("capitalize", capitalize);
     tm.register_tool("trim", trim);
+    tm.register_tool("split", split);
+    tm.register_tool("join", join);
+    tm.register_tool("replace", replace);
+    tm.register_tool("substring", substring);
+    tm.register_tool("indexOf", indexOf);
+    tm.register_tool("regexMatch", regexMatch);
+    tm.register_tool("regexExtract", regexExtract);
+    tm.register_tool("regexReplace", regexReplace);
 }
 
-// TODO: toString, split, join, replace, substring, regexReplace, etc.
+// TODO: toString, etc.
+
+StringTools::TraverseOptions::TraverseOptions(const ordered_json &options) {
+    traverseModeError = deferred([&] {
+        const string traverse_mode = ToolsManager::get_option(options, "traverseMode", string("both"));
+        arrays = traverse_mode == "array" || traverse_mode == "both";
+        objects = traverse_mode == "object" || traverse_mode == "both";
+    });
+    applyToError = deferred([&] {
+        applyToKeys = ToolsManager::get_option(options, "applyToKeys", false);
+        applyToValues = ToolsManager::get_option(options, "applyToValues", true);
+    });
+    convertAllToStringError = deferred([&] {
+        convertAllToString = ToolsManager::get_option(options, "convertAllToString", false);
+    });
+}
+
+StringTools::CapitalizeOptions::CapitalizeOptions(const ordered_json &options)
+    : TraverseOptions(options),
+      firstOnly(ToolsManager::get_option(options, "firstOnly", false)),
+      forceLower(ToolsManager::get_option(options, "forceLower", true)) {
+}
+
+StringTools::TrimOptions::TrimOptions(const ordered_json &options) : TraverseOptions(options) {
+    const string side = ToolsManager::get_option(options, "side", string("both"));
+    left = side == "left" || side == "both";
+    right = side == "right" || side == "both";
+}
+
+StringTools::DirnameOptions::DirnameOptions(const ordered_json &options)
+    : TraverseOptions(options),
+      separator(ToolsManager::get_option(options, "separator", '/')),
+      onlyIfFilenameContains(ToolsManager::get_option<string>(options, "onlyIfFilenameContains")) {
+}
+
+StringTools::SplitOptions::SplitOptions(const ordered_json &options)
+    : TraverseOptions(options),
+      separator(ToolsManager::get_option(options, "separator", string(","))),
+      limit(ToolsManager::get_option(options, "limit", size_t{0})),
+      skipEmpty(ToolsManager::get_option(options, "skipEmpty", false)) {
+}
+
+StringTools::JoinOptions::JoinOptions(const ordered_json &options)
+    : separator(ToolsManager::get_option(options, "separator", string(","))) {
+}
+
+StringTools::ReplaceOptions::ReplaceOptions(const ordered_json &options)
+    : TraverseOptions(options),
+      search(ToolsManager::get_option(options, "search", string())),
+      replacement(ToolsManager::get_option(options, "replacement", string())),
+      all(ToolsManager::get_option(options, "all", true)) {
+    if (search.size() >= SEARCHER_MIN_PATTERN) searcher.emplace(search.cbegin(), search.cend());
+}
+
+StringTools::SubstringOptions::SubstringOptions(const ordered_json &options)
+    : TraverseOptions(options),
+      start(ToolsManager::get_option(options, "start", 0LL)),
+      end(ToolsManager::get_option<long long>(options, "end")),
+      length(ToolsManager::get_option<long long>(options, "length")) {
+}
+
+StringTools::IndexOfOptions::IndexOfOptions(const ordered_json &options)
+    : TraverseOptions(options),
+      search(ToolsManager::get_option(options, "search", string())),
+      from(ToolsManager::get_option(options, "from", 0LL)) {
+}
+
+StringTools::RegexOptions::RegexOptions(const ordered_json &options) : TraverseOptions(options) {
+    const optional<string> pattern = ToolsManager::get_option<string>(options, "pattern");
+    if (!pattern) throw invalid_argument("option 'pattern' is required");
+    regex = RegexCache::instance().get(*pattern, ToolsManager::get_option(options, "flags", string()));
+}
+
+StringTools::RegexExtractOptions::RegexExtractOptions(const ordered_json &options)
+    : RegexOptions(options),
+      group(ToolsManager::get_option(options, "group", size_t{0})),
+      all(ToolsManager::get_option(options, "all", false)) {
+    if (group > regex->groups())
+        throw invalid_argument(std::format("no group {} in pattern '{}'", group, regex->pattern()));
+}
+
+StringTools::RegexReplaceOptions::RegexReplaceOptions(const ordered_json &options)
+    : RegexOptions(options),
+      replacement(ToolsManager::get_option(options, "replacement", string())),
+      all(ToolsManager::get_option(options, "all", true)) {
+}
+
+// UTF-8 positions: code points are counted by their first byte (any byte but a continuation byte)
+static bool is_code_point_start(const char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+}
+
+static size_t utf8_length(const string_view s) {
+    return static_cast<size_t>(ranges::count_if(s, is_code_point_start));
+}
+
+// byte offset of the code point at index n (s.size() past the end)
+static size_t utf8_offset(const string_view s, size_t n) {
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (is_code_point_start(s[i]) && n-- == 0) return i;
+    }
+    return s.size();
+}
+
+// position option: a negative one counts from the end; clamped to [0, length]
+static size_t clamp_index(const long long index, const size_t length) {
+    if (index < 0) return static_cast<size_t>(-index) > length ? 0 : length - static_cast<size_t>(-index);
+    return min(static_cast<size_t>(index), length);
+}
 
 /**
- * Convert strings to uppercase.
+ * Convert strings to uppercase (ASCII and the Latin, Greek and Cyrillic letters of UTF-8 text, see TextTransform).
  *
- * @param input The input JSON structure.
+ * @param input The input JSON structure (transformed in place).
  * @param options Options dictating how to traverse and apply the operation (see traverse).
  * @param ctx Context (not used in this function).
  * @param metadata Metadata (not used in this function).
  * @return The transformed JSON structure with strings converted to uppercase.
  */
-ordered_json StringTools::upper(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+ordered_json StringTools::upper(ordered_json &&input, const TraverseOptions &options, const ordered_json &ctx,
                                 json &metadata) {
     // cerr << "upper:" << input.dump() << endl;
-    auto operation = [](string s) {
-        ranges::transform(s, s.begin(), [](const unsigned char c) { return toupper(c); });
-        return s;
-    };
-    return _traverse(operation, input, options, ctx);
+    auto operation = [](string &s) { TextTransform::upper(s); };
+    _traverse(operation, input, options);
+    return std::move(input);
 }
 
 /**
- * Convert strings to lowercase.
+ * Convert strings to lowercase (ASCII and the Latin, Greek and Cyrillic letters of UTF-8 text, see TextTransform).
  *
- * @param input The input JSON structure.
+ * @param input The input JSON structure (transformed in place).
  * @param options Options dictating how to traverse and apply the operation (see traverse).
  * @param ctx Context (not used in this function).
  * @param metadata Metadata (not used in this function).
  * @return The transformed JSON structure with strings converted to lowercase.
  */
-ordered_json StringTools::lower(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+ordered_json StringTools::lower(ordered_json &&input, const TraverseOptions &options, const ordered_json &ctx,
                                 json &metadata) {
     // cerr << "lower:" << input.dump() << endl;
-    auto operation = [](string s) {
-        ranges::transform(s, s.begin(), [](const unsigned char c) { return tolower(c); });
-        return s;
-    };
-    return _traverse(operation, input, options, ctx);
+    auto operation = [](string &s) { TextTransform::lower(s); };
+    _traverse(operation, input, options);
+    return std::move(input);
 }
 
 /**
  * Capitalize the first letter of each word in strings.
  *
- * @param input The input JSON structure.
+ * @param input The input JSON structure (transformed in place).
  * @param options Options dictating how to traverse and apply the operation:
  *                  firstOnly: bool (default: false) - whether to capitalize only the first character of the string
  *                  forceLower: bool (default: true) - whether to lowercase the entire string before capitalizing
@@ -69,45 +186,23 @@ ordered_json StringTools::lower(const ordered_json &input, const ordered_json &o
  * @param metadata Metadata (not used in this function).
  * @return The transformed JSON structure with strings capitalized.
  */
-ordered_json StringTools::capitalize(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
-                                     json &metadata) {
+ordered_json StringTools::capitalize(ordered_json &&input, const CapitalizeOptions &options,
+                                     const ordered_json &ctx, json &metadata) {
     // cerr << "capitalize:" << input.dump() << endl;
-    const bool firstOnly = ToolsManager::get_option(options, "firstOnly", false);
-    const bool forceLower = ToolsManager::get_option(options, "forceLower", true);
-
-    auto operation = [firstOnly, forceLower](string s) {
-        if (s.empty()) return s;
-
-        string result(s);
-
-        // Optionally lowercase the entire string first
-        if (forceLower) {
-            ranges::transform(result, result.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
-        }
-
-        bool newWord = true;
-        for (auto &ch: result) {
-            if (isalpha(static_cast<unsigned char>(ch))) {
-                if (newWord) {
-                    ch = static_cast<char>(toupper(ch));
-                    if (firstOnly) break; // only the very first character
-                    newWord = false;
-                }
-            } else {
-                // any non-letter separates words
-                newWord = true;
-            }
-        }
+    const bool firstOnly = options.firstOnly;
+    const bool forceLower = options.forceLower;
 
-        return result;
+    auto operation = [firstOnly, forceLower](string &s) {
+        TextTransform::capitalize(s, firstOnly, forceLower);
     };
-    return _traverse(operation, input, options, ctx);
+    _traverse(operation, input, options);
+    return std::move(input);
 }
 
 /**
  * Trim whitespace from the beginning and end of strings.
  *
- * @param input The input JSON structure.
+ * @param input The input JSON structure (transformed in place).
  * @param options Options dictating how to traverse and apply the operation:
  *                  side: "both" (default), "left", "right" - which side(s) to trim
  *                  (see traverse for other options)
@@ -115,31 +210,20 @@ ordered_json StringTools::capitalize(const ordered_json &input, const ordered_js
  * @param metadata Metadata (not used in this function).
  * @return The transformed JSON structure with strings trimmed.
  */
-ordered_json StringTools::trim(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+ordered_json StringTools::trim(ordered_json &&input, const TrimOptions &options, const ordered_json &ctx,
                                json &metadata) {
-    const string side = ToolsManager::get_option(options, "side", string("both"));
-
-    auto operation = [side](string s) {
-        if (s.empty()) return s;
+    const bool left = options.left;
+    const bool right = options.right;
 
-        auto is_space = [](unsigned char c) { return std::isspace(c); };
-        if (side == "left" || side == "both") {
-            s.erase(s.begin(), ranges::find_if_not(s, is_space));
-        }
-
-        if (side == "right" || side == "both") {
-            s.erase(std::find_if_not(s.rbegin(), s.rend(), is_space).base(), s.end());
-        }
-
-        return s;
-    };
-    return _traverse(operation, input, options, ctx);
+    auto operation = [left, right](string &s) { TextTransform::trim(s, left, right); };
+    _traverse(operation, input, options);
+    return std::move(input);
 }
 
 /**
  * Get the directory name from file paths in strings.
  *
- * @param input The input JSON structure.
+ * @param input The input JSON structure (transformed in place).
  * @param options Options dictating how to traverse and apply the operation:
  *                  separator: char (default: '/') - the path separator
  *                  onlyIfFilenameContains: string (optional) - only apply dirname if the filename contains this substring
@@ -148,89 +232,373 @@ ordered_json StringTools::trim(const ordered_json &input, const ordered_json &op
  * @param metadata Metadata (not used in this function).
  * @return The transformed JSON structure with directory names.
  */
-ordered_json StringTools::dirname(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+ordered_json StringTools::dirname(ordered_json &&input, const DirnameOptions &options, const ordered_json &ctx,
                                   json &metadata) {
-    const char separator = ToolsManager::get_option(options, "separator", '/');
-    const optional<string> filenameContains = ToolsManager::get_option<string>(options, "onlyIfFilenameContains");
+    const char separator = options.separator;
+    const optional<string> &filenameContains = options.onlyIfFilenameContains;
 
-    auto operation = [separator, filenameContains](const string &path) {
-        if (path.empty()) return std::format("{}", separator);
+    auto operation = [separator, &filenameContains](string &path) {
+        if (path.empty()) {
+            path.assign(1, separator);
+            return;
+        }
         const auto pos = path.rfind(separator);
-        const std::string last_segment =
-                (pos == std::string::npos ? path : path.substr(pos + 1));
         if (filenameContains) {
-            if (last_segment.find(filenameContains.value()) != std::string::npos) {
-                return path.substr(0, pos + 1);
+            const string_view last_segment = string_view(path).substr(pos == string::npos ? 0 : pos + 1);
+            if (last_segment.find(filenameContains.value()) == string_view::npos) return;
+        }
+        path.erase(pos + 1);
+    };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
+
+/**
+ * Split strings into arrays of strings.
+ *
+ * @param input The input JSON structure (its strings are replaced by their parts).
+ * @param options Options dictating how to split and traverse:
+ *                  separator: string (default: ",") - the separator; an empty one splits into code points
+ *                  limit: number (default: 0, no limit) - max parts, the last one holding the rest of the string
+ *                  skipEmpty: bool (default: false) - whether to leave out empty parts
+ *                  (see traverse for other options; keys are not split)
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with strings split.
+ */
+ordered_json StringTools::split(ordered_json &&input, const SplitOptions &options, const ordered_json &ctx,
+                                json &metadata) {
+    auto operation = [&options](const string &s) {
+        ordered_json parts = ordered_json::array();
+        const string_view text = s;
+        const string_view separator = options.separator;
+        const auto add = [&](const string_view part) {
+            if (!options.skipEmpty || !part.empty()) parts.emplace_back(string(part));
+        };
+
+        size_t start = 0;
+        while (start < text.size() && (options.limit == 0 || parts.size() + 1 < options.limit)) {
+            size_t next;
+            if (separator.empty()) {
+                next = start + 1;
+                while (next < text.size() && !is_code_point_start(text[next])) ++next;
+                add(text.substr(start, next - start));
+                start = next;
+                continue;
             }
-            return path;
+            next = text.find(separator, start);
+            if (next == string_view::npos) break;
+            add(text.substr(start, next - start));
+            start = next + separator.size();
+        }
+        if (start < text.size() || !separator.empty()) add(text.substr(start));
+        return parts;
+    };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
+
+/**
+ * Join the items of an array into a string.
+ *
+ * @param input The input array; strings are joined as they are, null items as empty strings, other items dumped.
+ *              Any other input is returned unchanged.
+ * @param options Options:
+ *                  separator: string (default: ",") - the separator between items
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The joined string.
+ */
+ordered_json StringTools::join(const ordered_json &input, const JoinOptions &options, const ordered_json &ctx,
+                               json &metadata) {
+    if (!input.is_array()) return input;
+    if (input.empty()) return string();
+
+    // dump the other items first, so that the result is allocated once
+    vector<string> dumped;
+    size_t size = options.separator.size() * (input.size() - 1);
+    for (const auto &item: input) {
+        if (item.is_string()) size += item.get_ref<const string &>().size();
+        else if (!item.is_null()) size += dumped.emplace_back(item.dump()).size();
+    }
+
+    string out;
+    out.reserve(size);
+    auto next_dumped = dumped.begin();
+    bool first = true;
+    for (const auto &item: input) {
+        if (!first) out += options.separator;
+        first = false;
+        if (item.is_string()) out += item.get_ref<const string &>();
+        else if (!item.is_null()) out += *next_dumped++;
+    }
+    return out;
+}
+
+/**
+ * Replace occurrences of a substring in strings.
+ *
+ * @param input The input JSON structure (transformed in place).
+ * @param options Options dictating what to replace:
+ *                  search: string - the substring to replace (nothing is replaced when empty)
+ *                  replacement: string (default: "") - the replacement
+ *                  all: bool (default: true) - whether to replace every occurrence or the first one only
+ *                  (see traverse for other options)
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with occurrences replaced.
+ */
+ordered_json StringTools::replace(ordered_json &&input, const ReplaceOptions &options, const ordered_json &ctx,
+                                  json &metadata) {
+    auto operation = [&options](string &s) {
+        const string_view search = options.search;
+        const string_view replacement = options.replacement;
+        if (search.empty()) return;
+
+        // long inputs: Boyer-Moore-Horspool (the searcher is built with the options), otherwise string_view::find
+        const bool use_searcher = options.searcher && s.size() >= ReplaceOptions::SEARCHER_MIN_INPUT;
+        const auto find = [&](const size_t from) {
+            if (!use_searcher) return string_view(s).find(search, from);
+            const char *begin = s.data();
+            const char *end = begin + s.size();
+            const char *found = (*options.searcher)(begin + from, end).first;
+            return found == end ? string::npos : static_cast<size_t>(found - begin);
+        };
+
+        size_t pos = find(0);
+        if (pos == string::npos) return;
+
+        // same size: overwritten in place
+        if (replacement.size() == search.size()) {
+            do {
+                ranges::copy(replacement, s.begin() + static_cast<ptrdiff_t>(pos));
+                pos = options.all ? find(pos + search.size()) : string::npos;
+            } while (pos != string::npos);
+            return;
         }
-        return path.substr(0, pos + 1);
+
+        string out;
+        out.reserve(s.size());
+        size_t last = 0;
+        do {
+            out.append(s, last, pos - last).append(replacement);
+            last = pos + search.size();
+            pos = options.all ? find(last) : string::npos;
+        } while (pos != string::npos);
+        out.append(s, last);
+        s = std::move(out);
     };
-    return _traverse(operation, input, options, ctx);
+    _traverse(operation, input, options);
+    return std::move(input);
 }
 
+/**
+ * Extract a part of strings.
+ *
+ * @param input The input JSON structure (transformed in place).
+ * @param options Options dictating the part to keep, in code points (negative positions count from the end):
+ *                  start: number (default: 0) - the first code point kept
+ *                  end: number (optional) - the code point after the last one kept (default: the end of the string)
+ *                  length: number (optional) - the number of code points kept (instead of end)
+ *                  (see traverse for other options)
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with substrings.
+ */
+ordered_json StringTools::substring(ordered_json &&input, const SubstringOptions &options, const ordered_json &ctx,
+                                    json &metadata) {
+    auto operation = [&options](string &s) {
+        // the length in code points is only needed for positions from the end
+        const bool from_end = options.start < 0 || (!options.length && options.end && *options.end < 0);
+        const size_t length = from_end ? utf8_length(s) : SIZE_MAX;
+
+        const size_t begin = clamp_index(options.start, length);
+        size_t end = length;
+        if (options.length) end = begin + static_cast<size_t>(max(*options.length, 0LL));
+        else if (options.end) end = clamp_index(*options.end, length);
+        if (end <= begin) {
+            s.clear();
+            return;
+        }
+
+        const size_t first = utf8_offset(s, begin);
+        if (end != SIZE_MAX) s.erase(first + utf8_offset(string_view(s).substr(first), end - begin));
+        s.erase(0, first);
+    };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
 
 /**
- * Traverse the input JSON structure and apply the operation to strings according to options.
+ * Find the position of a substring in strings.
  *
- * @param operation The string operation to apply.
- * @param input The input JSON structure.
- * @param options Options dictating how to traverse and apply the operation:
- *                  traverse: "none" (just dump the input to string), "array", "object", "both" (default: "both")
- *                  kv: "both" (default), "key", "value" (only for object traversal)
- *                  toString: bool (default: false) - whether to convert non-string values to string before applying operation
+ * @param input The input JSON structure (its strings are replaced by the positions).
+ * @param options Options dictating what to find:
+ *                  search: string - the substring to find
+ *                  from: number (default: 0) - the code point to start from (negative: from the end)
+ *                  (see traverse for other options; keys are left as they are)
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with the code point index of the first occurrence, or -1.
+ */
+ordered_json StringTools::indexOf(ordered_json &&input, const IndexOfOptions &options, const ordered_json &ctx,
+                                  json &metadata) {
+    auto operation = [&options](const string &s) -> ordered_json {
+        const string_view text = s;
+        const size_t from = options.from < 0
+                                ? clamp_index(options.from, utf8_length(text))
+                                : static_cast<size_t>(options.from);
+        const size_t pos = text.find(options.search, utf8_offset(text, from));
+        if (pos == string_view::npos) return -1;
+        return utf8_length(text.substr(0, pos));
+    };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
+
+/**
+ * Test strings against a regular expression.
+ *
+ * @param input The input JSON structure (its strings are replaced by the results).
+ * @param options Options dictating the regular expression:
+ *                  pattern: string - the regular expression (ECMAScript syntax), found anywhere in the string
+ *                  flags: string (default: "") - "i" (ignore case), "m" (^ and $ match at line breaks)
+ *                  (see traverse for other options; keys are left as they are)
+ *                Matching is byte-based: a non-ASCII character is several bytes for the pattern, e.g. "héllo"
+ *                does not match "^h.l" ('.' is a single byte) (see Regex).
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with true where the pattern matches, false elsewhere.
+ */
+ordered_json StringTools::regexMatch(ordered_json &&input, const RegexOptions &options, const ordered_json &ctx,
+                                     json &metadata) {
+    const Regex &regex = *options.regex;
+    auto operation = [&regex](const string &s) -> ordered_json { return regex.search(s); };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
+
+/**
+ * Extract the matches of a regular expression from strings.
+ *
+ * @param input The input JSON structure (its strings are replaced by the matches).
+ * @param options Options dictating the regular expression and what to extract:
+ *                  pattern, flags: the regular expression (see regexMatch)
+ *                  group: number (default: 0, the whole match) - the capture group to extract
+ *                  all: bool (default: false) - whether to extract every match (as an array) or the first one
+ *                  (see traverse for other options; keys are left as they are)
+ * @param ctx Context (not used in this function).
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with the matched text (null without a match), or arrays of them.
+ */
+ordered_json StringTools::regexExtract(ordered_json &&input, const RegexExtractOptions &options,
+                                       const ordered_json &ctx, json &metadata) {
+    const Regex &regex = *options.regex;
+    auto operation = [&regex, &options](const string &s) -> ordered_json {
+        if (options.all) return regex.extract_all(s, options.group);
+        optional<string> match = regex.extract(s, options.group);
+        if (!match) return nullptr;
+        return std::move(*match);
+    };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
+
+/**
+ * Replace the matches of a regular expression in strings.
+ *
+ * @param input The input JSON structure (transformed in place).
+ * @param options Options dictating the regular expression and the replacement:
+ *                  pattern, flags: the regular expression (see regexMatch)
+ *                  replacement: string (default: "") - the replacement; $&, $1... and $$ as in ECMAScript
+ *                  all: bool (default: true) - whether to replace every match or the first one only
+ *                  (see traverse for other options)
  * @param ctx Context (not used in this function).
- * @return The transformed JSON structure.
+ * @param metadata Metadata (not used in this function).
+ * @return The transformed JSON structure with the matches replaced.
+ */
+ordered_json StringTools::regexReplace(ordered_json &&input, const RegexReplaceOptions &options,
+                                       const ordered_json &ctx, json &metadata) {
+    const Regex &regex = *options.regex;
+    auto operation = [&regex, &options](string &s) { s = regex.replace(s, options.replacement, options.all); };
+    _traverse(operation, input, options);
+    return std::move(input);
+}
+
+
+/**
+ * Traverse the JSON structure and apply the operation in place to its strings according to options.
+ * Arrays and object values are transformed where they are; objects are rebuilt only when keys change.
+ *
+ * @param operation The string operation to apply: operation(string &) transforms the string in place, or returns
+ *                  the value replacing it (such operations are not applied to keys).
+ * @param value The JSON structure to transform.
+ * @param options Options dictating how to traverse and apply the operation (parsed once per call, see TraverseOptions;
+ *                a malformed option fails when it is read, as when it was read here):
+ *                  traverseMode: "none" (just dump the input to string), "array", "object", "both" (default: "both")
+ *                  applyToKeys: bool (default: false), applyToValues: bool (default: true) (only for object traversal)
+ *                  convertAllToString: bool (default: false) - whether to convert non-string values to string before applying operation
  */
-ordered_json StringTools::_traverse(const function<string(string)> &operation,
-                                    const ordered_json &input,
-                                    const ordered_json &options,
-                                    const ordered_json &ctx) {
+template<typename Operation>
+void StringTools::_traverse(const Operation &operation, ordered_json &value, const TraverseOptions &options) {
+    constexpr bool in_place = is_void_v<invoke_result_t<const Operation &, string &>>;
+    const auto apply = [&operation](ordered_json &string_value) {
+        if constexpr (in_place) operation(string_value.get_ref<string &>());
+        else string_value = operation(string_value.get_ref<string &>());
+    };
+
     // Handle null input
-    if (input.is_null())
-        return nullptr;
+    if (value.is_null())
+        return;
 
     // Handle string
-    if (input.is_string()) {
-        return operation(input.get<string>());
+    if (value.is_string()) {
+        apply(value);
+        return;
     }
 
-    // Extract traverse mode (default: "both")
-    const string traverse_mode = ToolsManager::get_option(options, "traverseMode", string("both"));
+    ToolOptions::rethrow(options.traverseModeError);
 
     // Handle arrays
-    if ((traverse_mode == "array" || traverse_mode == "both") && input.is_array()) {
-        ordered_json array = ordered_json::array();
-        for (const auto &el: input) {
-            array.push_back(_traverse(operation, el, options, ctx));
+    if (options.arrays && value.is_array()) {
+        for (auto &el: value) {
+            _traverse(operation, el, options);
         }
-        return array;
+        return;
     }
 
     // Handle objects
-    if ((traverse_mode == "object" || traverse_mode == "both") && input.is_object()) {
-        const bool applyToKeys = ToolsManager::get_option(options, "applyToKeys", false);
-        const bool applyToValues = ToolsManager::get_option(options, "applyToValues", true);
-        ordered_json object = ordered_json::object();
-        for (const auto &[key, value]: input.items()) {
-            string new_key = key;
-            if (applyToKeys) {
-                new_key = operation(new_key);
+    if (options.objects && value.is_object()) {
+        ToolOptions::rethrow(options.applyToError);
+        if (!in_place || !options.applyToKeys) {
+            if (options.applyToValues) {
+                for (auto &el: value) {
+                    _traverse(operation, el, options);
+                }
             }
+            return;
+        }
+
+        // keys change: rebuild the object, moving the values
+        ordered_json object = ordered_json::object();
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            string new_key = it.key();
+            if constexpr (in_place) operation(new_key);
 
-            if (applyToValues) {
-                object[new_key] = _traverse(operation, value, options, ctx);
-            } else {
-                object[new_key] = value;
+            ordered_json &el = object[std::move(new_key)];
+            el = std::move(it.value());
+            if (options.applyToValues) {
+                _traverse(operation, el, options);
             }
         }
-        return object;
+        value = std::move(object);
+        return;
     }
 
-    if (ToolsManager::get_option(options, "convertAllToString", false)) {
+    ToolOptions::rethrow(options.convertAllToStringError);
+    if (options.convertAllToString) {
         // dump to string and transform it
-        return operation(input.dump());
+        value = value.dump();
+        apply(value);
     }
-
-    return input;
 }
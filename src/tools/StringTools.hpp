@@ -1,6 +1,12 @@
 #pragma once
 #include <nlohmann/json_fwd.hpp>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "../RegexCache.hpp"
+#include "../ToolsManager.hpp"
 
 using json = nlohmann::json;
 using ordered_json = nlohmann::ordered_json;
@@ -10,24 +16,151 @@ namespace jz {
     public:
         static void init();
 
+        // options shared by the string tools (see _traverse); each group is checked when the traversal reads it
+        struct TraverseOptions : ToolOptions {
+            bool arrays = true; // traverseMode: "array" or "both"
+            bool objects = true; // traverseMode: "object" or "both"
+            bool applyToKeys = false;
+            bool applyToValues = true;
+            bool convertAllToString = false;
+            std::exception_ptr traverseModeError; // read for inputs other than null and strings
+            std::exception_ptr applyToError; // applyToKeys / applyToValues: read for traversed objects
+            std::exception_ptr convertAllToStringError; // read for values left as they are
+
+            explicit TraverseOptions(const ordered_json &options);
+        };
+
+        struct CapitalizeOptions : TraverseOptions {
+            bool firstOnly;
+            bool forceLower;
+
+            explicit CapitalizeOptions(const ordered_json &options);
+        };
+
+        struct TrimOptions : TraverseOptions {
+            bool left; // side: "left" or "both"
+            bool right; // side: "right" or "both"
+
+            explicit TrimOptions(const ordered_json &options);
+        };
+
+        struct DirnameOptions : TraverseOptions {
+            char separator;
+            std::optional<std::string> onlyIfFilenameContains;
+
+            explicit DirnameOptions(const ordered_json &options);
+        };
+
+        struct SplitOptions : TraverseOptions {
+            std::string separator;
+            size_t limit; // max parts, the last one holding the rest of the string (0: no limit)
+            bool skipEmpty;
+
+            explicit SplitOptions(const ordered_json &options);
+        };
+
+        struct JoinOptions : ToolOptions {
+            std::string separator;
+
+            explicit JoinOptions(const ordered_json &options);
+        };
+
+        struct ReplaceOptions : TraverseOptions {
+            // inputs from this size are searched with the Boyer-Moore-Horspool searcher (when it is built)
+            static constexpr size_t SEARCHER_MIN_INPUT = 256;
+            static constexpr size_t SEARCHER_MIN_PATTERN = 4;
+
+            std::string search;
+            std::string replacement;
+            bool all;
+            std::optional<std::boyer_moore_horspool_searcher<std::string::const_iterator>> searcher;
+
+            explicit ReplaceOptions(const ordered_json &options);
+
+            // the searcher refers to search
+            ReplaceOptions(const ReplaceOptions &) = delete;
+
+            ReplaceOptions &operator=(const ReplaceOptions &) = delete;
+        };
+
+        // positions are in code points; negative ones count from the end
+        struct SubstringOptions : TraverseOptions {
+            long long start;
+            std::optional<long long> end;
+            std::optional<long long> length; // instead of end
+
+            explicit SubstringOptions(const ordered_json &options);
+        };
+
+        struct IndexOfOptions : TraverseOptions {
+            std::string search;
+            long long from;
+
+            explicit IndexOfOptions(const ordered_json &options);
+        };
+
+        // pattern (required) and flags, compiled through the regex cache
+        struct RegexOptions : TraverseOptions {
+            std::shared_ptr<const Regex> regex;
+
+            explicit RegexOptions(const ordered_json &options);
+        };
+
+        struct RegexExtractOptions : RegexOptions {
+            size_t group;
+            bool all;
+
+            explicit RegexExtractOptions(const ordered_json &options);
+        };
+
+        struct RegexReplaceOptions : RegexOptions {
+            std::string replacement;
+            bool all;
+
+            explicit RegexReplaceOptions(const ordered_json &options);
+        };
+
     private:
-        static ordered_json upper(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+        static ordered_json upper(ordered_json &&input, const TraverseOptions &options, const ordered_json &ctx,
                                   json &metadata);
 
-        static ordered_json lower(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+        static ordered_json lower(ordered_json &&input, const TraverseOptions &options, const ordered_json &ctx,
                                   json &metadata);
 
-        static ordered_json capitalize(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
-                                       json &metadata);
+        static ordered_json capitalize(ordered_json &&input, const CapitalizeOptions &options,
+                                       const ordered_json &ctx, json &metadata);
 
-        static ordered_json trim(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+        static ordered_json trim(ordered_json &&input, const TrimOptions &options, const ordered_json &ctx,
                                  json &metadata);
 
-        static ordered_json dirname(const ordered_json &input, const ordered_json &options, const ordered_json &ctx,
+        static ordered_json dirname(ordered_json &&input, const DirnameOptions &options, const ordered_json &ctx,
                                     json &metadata);
 
-        static ordered_json _traverse(const std::function<std::string(std::string s)> &operation,
-                                      const ordered_json &input,
-                                      const ordered_json &options, const ordered_json &ctx);
+        static ordered_json split(ordered_json &&input, const SplitOptions &options, const ordered_json &ctx,
+                                  json &metadata);
+
+        static ordered_json join(const ordered_json &input, const JoinOptions &options, const ordered_json &ctx,
+                                 json &metadata);
+
+        static ordered_json replace(ordered_json &&input, const ReplaceOptions &options, const ordered_json &ctx,
+                                    json &metadata);
+
+        static ordered_json substring(ordered_json &&input, const SubstringOptions &options, const ordered_json &ctx,
+                                      json &metadata);
+
+        static ordered_json indexOf(ordered_json &&input, const IndexOfOptions &options, const ordered_json &ctx,
+                                    json &metadata);
+
+        static ordered_json regexMatch(ordered_json &&input, const RegexOptions &options, const ordered_json &ctx,
+                                       json &metadata);
+
+        static ordered_json regexExtract(ordered_json &&input, const RegexExtractOptions &options,
+                                         const ordered_json &ctx, json &metadata);
+
+        static ordered_json regexReplace(ordered_json &&input, const RegexReplaceOptions &options,
+                                         const ordered_json &ctx, json &metadata);
+
+        template<typename Operation>
+        static void _traverse(const Operation &operation, ordered_json &value, const TraverseOptions &options);
     };
 }
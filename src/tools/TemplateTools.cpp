@@ -54,19 +54,22 @@ ordered_json TemplateTools::operator()(const ordered_json &input, const ordered_
     string jz_input = getInclude(options, nullptr, metadata);
     const bool contextualInclude = jz_input.empty();
     if (input.is_array()) {
+        // items rendering as undefined are left out
         ordered_json result(ordered_json::array());
         for (auto &item: input) {
+            ordered_json rendered;
             if (!ctx.empty()) {
                 ordered_json _item(item);
                 _item.merge_patch(ctx);
                 if (contextualInclude)
                     jz_input = getInclude(options, _item, metadata);
-                result.push_back(Processor::to_json(jz_input, _item, metadata));
+                rendered = Processor::to_json(jz_input, _item, metadata);
             } else {
                 if (contextualInclude)
                     jz_input = getInclude(options, item, metadata);
-                result.push_back(Processor::to_json(jz_input, item, metadata));
+                rendered = Processor::to_json(jz_input, item, metadata);
             }
+            if (!Processor::is_undefined(rendered)) result.push_back(std::move(rendered));
         }
         return result;
     }
@@ -0,0 +1,349 @@
+#include "TextTransform.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JZ_TEXT_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace jz {
+    /* -------------------------
+       Case tables
+       - delta to add to a code point below U+0800 (one or two UTF-8 bytes) to change its case; 0 when it has
+         no mapping of the same encoded length
+       ------------------------- */
+
+    struct CaseRange {
+        char16_t first;
+        char16_t last;
+        int16_t delta;
+        bool alternate; // every other code point from first (alternating upper / lower case pairs)
+    };
+
+    static constexpr CaseRange TO_UPPER[] = {
+        {u'a', u'z', -0x20, false},
+        {0x00B5, 0x00B5, 0x02E7, false}, // micro sign -> Greek capital mu
+        {0x00E0, 0x00F6, -0x20, false},
+        {0x00F8, 0x00FE, -0x20, false},
+        {0x00FF, 0x00FF, 0x79, false},
+        {0x0101, 0x012F, -1, true},
+        {0x0133, 0x0137, -1, true},
+        {0x013A, 0x0148, -1, true},
+        {0x014B, 0x0177, -1, true},
+        {0x017A, 0x017E, -1, true},
+        {0x03AC, 0x03AC, -0x26, false},
+        {0x03AD, 0x03AF, -0x25, false},
+        {0x03B1, 0x03C1, -0x20, false},
+        {0x03C2, 0x03C2, -0x1F, false}, // final sigma
+        {0x03C3, 0x03CB, -0x20, false},
+        {0x03CC, 0x03CC, -0x40, false},
+        {0x03CD, 0x03CE, -0x3F, false},
+        {0x0430, 0x044F, -0x20, false},
+        {0x0450, 0x045F, -0x50, false},
+    };
+
+    static constexpr CaseRange TO_LOWER[] = {
+        {u'A', u'Z', 0x20, false},
+        {0x00C0, 0x00D6, 0x20, false},
+        {0x00D8, 0x00DE, 0x20, false},
+        {0x0100, 0x012E, 1, true},
+        {0x0132, 0x0136, 1, true},
+        {0x0139, 0x0147, 1, true},
+        {0x014A, 0x0176, 1, true},
+        {0x0178, 0x0178, -0x79, false},
+        {0x0179, 0x017D, 1, true},
+        {0x0386, 0x0386, 0x26, false},
+        {0x0388, 0x038A, 0x25, false},
+        {0x038C, 0x038C, 0x40, false},
+        {0x038E, 0x038F, 0x3F, false},
+        {0x0391, 0x03A1, 0x20, false},
+        {0x03A3, 0x03AB, 0x20, false},
+        {0x0400, 0x040F, 0x50, false},
+        {0x0410, 0x042F, 0x20, false},
+    };
+
+    using CaseTable = array<int16_t, 0x800>;
+
+    template<size_t N>
+    static consteval CaseTable make_case_table(const CaseRange (&ranges)[N]) {
+        CaseTable table{};
+        for (const CaseRange &r: ranges)
+            for (size_t cp = r.first; cp <= r.last; cp += r.alternate ? 2 : 1) table[cp] = r.delta;
+        return table;
+    }
+
+    static constexpr CaseTable UPPER_TABLE = make_case_table(TO_UPPER);
+    static constexpr CaseTable LOWER_TABLE = make_case_table(TO_LOWER);
+
+    /* -------------------------
+       UTF-8
+       ------------------------- */
+
+    static bool is_space(const char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    // code point at p and its length; an invalid, overlong or truncated sequence is U+FFFD, one byte long
+    static char32_t decode(const char *p, const char *end, size_t &len) {
+        // smallest code point of each sequence length (below it the encoding is overlong)
+        static constexpr char32_t MIN_CODE_POINT[] = {0, 0, 0x80, 0x800, 0x10000};
+        const auto b0 = static_cast<unsigned char>(*p);
+        len = 1;
+        if (b0 < 0x80) return b0;
+        // continuation bytes and the overlong lead bytes C0 / C1 cannot start a sequence
+        if (b0 < 0xC2 || b0 > 0xF4) return 0xFFFD;
+        const size_t n = b0 >= 0xF0 ? 4 : b0 >= 0xE0 ? 3 : 2;
+        if (static_cast<size_t>(end - p) < n) return 0xFFFD;
+        char32_t cp = b0 & (0x7F >> n);
+        for (size_t k = 1; k < n; ++k) {
+            const auto b = static_cast<unsigned char>(p[k]);
+            if ((b & 0xC0) != 0x80) return 0xFFFD;
+            cp = cp << 6 | (b & 0x3F);
+        }
+        if (cp < MIN_CODE_POINT[n]) return 0xFFFD;
+        len = n;
+        return cp;
+    }
+
+    // rewrite the code point at p (len bytes) through the table
+    static void map_code_point(char *p, const char32_t cp, const size_t len, const CaseTable &table) {
+        if (cp >= table.size() || !table[cp]) return;
+        const auto mapped = static_cast<char32_t>(static_cast<int32_t>(cp) + table[cp]);
+        if (len == 1) {
+            p[0] = static_cast<char>(mapped);
+        } else {
+            p[0] = static_cast<char>(0xC0 | mapped >> 6);
+            p[1] = static_cast<char>(0x80 | (mapped & 0x3F));
+        }
+    }
+
+    // map the code points starting before stop; returns where the last one ends (it may run past stop)
+    static char *map_until(char *p, const char *stop, const char *end, const CaseTable &table) {
+        while (p < stop) {
+            size_t len;
+            const char32_t cp = decode(p, end, len);
+            map_code_point(p, cp, len, table);
+            p += len;
+        }
+        return p;
+    }
+
+    // letters continue a word; punctuation, symbols, spaces and invalid bytes separate words
+    static bool is_letter(const char32_t cp) {
+        if (cp < 0x80) return (cp | 0x20) >= 'a' && (cp | 0x20) <= 'z';
+        if (cp < UPPER_TABLE.size() && (UPPER_TABLE[cp] || LOWER_TABLE[cp])) return true;
+        if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return false; // Latin-1 controls, punctuation, signs
+        if (cp >= 0x2000 && cp < 0x2C00) return false; // general punctuation, symbols
+        if (cp >= 0x3000 && cp < 0x3040) return false; // CJK punctuation
+        return cp != 0xFFFD;
+    }
+
+    /* -------------------------
+       ASCII block kernels
+       - they work on whole blocks only and leave the rest to the caller's byte loop
+       ------------------------- */
+
+    struct Kernels {
+        // flip the case of the letters [first, first + 26) in the pure-ASCII blocks at the start of [p, p + n);
+        // returns the bytes done (it stops at the first block holding a non-ASCII byte)
+        size_t (*flip_ascii)(char *p, size_t n, char first);
+        // whitespace bytes at the start of [p, p + n) (a lower bound)
+        size_t (*leading_spaces)(const char *p, size_t n);
+        // end of [p, p + n) without its trailing whitespace (an upper bound)
+        size_t (*content_end)(const char *p, size_t n);
+        size_t block;
+        const char *name;
+    };
+
+    static size_t flip_ascii_scalar(char *, size_t, char) {
+        return 0;
+    }
+
+    static size_t leading_spaces_scalar(const char *, size_t) {
+        return 0;
+    }
+
+    static size_t content_end_scalar(const char *, const size_t n) {
+        return n;
+    }
+
+#ifdef JZ_TEXT_X86
+    // letters [first, first + 26) are the bytes below -128 + 26 once shifted by 0x80 - first (signed compare)
+    __attribute__((target("sse2")))
+    static size_t flip_ascii_sse2(char *p, const size_t n, const char first) {
+        const __m128i shift = _mm_set1_epi8(static_cast<char>(0x80 - first));
+        const __m128i limit = _mm_set1_epi8(static_cast<char>(-128 + 26));
+        const __m128i bit = _mm_set1_epi8(0x20);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+            if (_mm_movemask_epi8(v)) break;
+            const __m128i letters = _mm_cmplt_epi8(_mm_add_epi8(v, shift), limit);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i), _mm_xor_si128(v, _mm_and_si128(letters, bit)));
+        }
+        return i;
+    }
+
+    // bit i set when p[i] is ' ' or in ['\t', '\r']
+    __attribute__((target("sse2")))
+    static unsigned space_mask_sse2(const char *p) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i controls = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - '\t'))),
+                                                _mm_set1_epi8(static_cast<char>(-128 + 5)));
+        return static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_or_si128(controls, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')))));
+    }
+
+    __attribute__((target("sse2")))
+    static size_t leading_spaces_sse2(const char *p, const size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const unsigned m = space_mask_sse2(p + i);
+            if (m != 0xFFFF) return i + countr_one(m);
+        }
+        return i;
+    }
+
+    __attribute__((target("sse2")))
+    static size_t content_end_sse2(const char *p, const size_t n) {
+        size_t e = n;
+        for (; e >= 16; e -= 16) {
+            const unsigned m = space_mask_sse2(p + e - 16);
+            if (m != 0xFFFF) return e - countl_one(static_cast<uint16_t>(m));
+        }
+        return e;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t flip_ascii_avx2(char *p, const size_t n, const char first) {
+        const __m256i shift = _mm256_set1_epi8(static_cast<char>(0x80 - first));
+        const __m256i limit = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+        const __m256i bit = _mm256_set1_epi8(0x20);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+            if (_mm256_movemask_epi8(v)) break;
+            const __m256i letters = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, shift));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(p + i),
+                                _mm256_xor_si256(v, _mm256_and_si256(letters, bit)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    static uint32_t space_mask_avx2(const char *p) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i controls = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 5)),
+                                                   _mm256_add_epi8(v, _mm256_set1_epi8(
+                                                                       static_cast<char>(0x80 - '\t'))));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(controls, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')))));
+    }
+
+    __attribute__((target("avx2")))
+    static size_t leading_spaces_avx2(const char *p, const size_t n) {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            const uint32_t m = space_mask_avx2(p + i);
+            if (m != UINT32_MAX) return i + countr_one(m);
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t content_end_avx2(const char *p, const size_t n) {
+        size_t e = n;
+        for (; e >= 32; e -= 32) {
+            const uint32_t m = space_mask_avx2(p + e - 32);
+            if (m != UINT32_MAX) return e - countl_one(m);
+        }
+        return e;
+    }
+#endif
+
+    static Kernels select_kernels() noexcept {
+#ifdef JZ_TEXT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return {flip_ascii_avx2, leading_spaces_avx2, content_end_avx2, 32, "avx2"};
+        if (__builtin_cpu_supports("sse2"))
+            return {flip_ascii_sse2, leading_spaces_sse2, content_end_sse2, 16, "sse2"};
+#endif
+        return {flip_ascii_scalar, leading_spaces_scalar, content_end_scalar, 16, "scalar"};
+    }
+
+    static const Kernels &kernels() noexcept {
+        static const Kernels selected = select_kernels();
+        return selected;
+    }
+
+    /* -------------------------
+       TextTransform
+       ------------------------- */
+
+    // ASCII blocks by the kernel; a block it stops at (or the tail) code point by code point
+    static void convert_case(string &s, const CaseTable &table, const char first) {
+        const Kernels &k = kernels();
+        char *p = s.data();
+        const char *end = p + s.size();
+        while (p < end) {
+            p += k.flip_ascii(p, static_cast<size_t>(end - p), first);
+            p = map_until(p, p + min(k.block, static_cast<size_t>(end - p)), end, table);
+        }
+    }
+
+    void TextTransform::upper(string &s) {
+        convert_case(s, UPPER_TABLE, 'a');
+    }
+
+    void TextTransform::lower(string &s) {
+        convert_case(s, LOWER_TABLE, 'A');
+    }
+
+    void TextTransform::capitalize(string &s, const bool firstOnly, const bool forceLower) {
+        // Optionally lowercase the entire string first
+        if (forceLower) lower(s);
+
+        bool newWord = true;
+        char *p = s.data();
+        const char *end = p + s.size();
+        while (p < end) {
+            size_t len;
+            const char32_t cp = decode(p, end, len);
+            if (is_letter(cp)) {
+                if (newWord) {
+                    map_code_point(p, cp, len, UPPER_TABLE);
+                    if (firstOnly) break; // only the very first letter
+                    newWord = false;
+                }
+            } else {
+                newWord = true;
+            }
+            p += len;
+        }
+    }
+
+    void TextTransform::trim(string &s, const bool left, const bool right) {
+        const Kernels &k = kernels();
+        if (right) {
+            size_t e = k.content_end(s.data(), s.size());
+            while (e > 0 && is_space(s[e - 1])) --e;
+            s.erase(e);
+        }
+        if (left) {
+            size_t b = k.leading_spaces(s.data(), s.size());
+            while (b < s.size() && is_space(s[b])) ++b;
+            s.erase(0, b);
+        }
+    }
+
+    const char *TextTransform::implementation() noexcept {
+        return kernels().name;
+    }
+} // namespace jz
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+namespace jz {
+    /* TextTransform:
+       - in-place case conversion and trimming of UTF-8 strings, used by the string tools
+       - pure-ASCII blocks (16 or 32 bytes) are converted / skipped with a SIMD kernel (AVX2, SSE2 or scalar,
+         chosen once at runtime from the CPU features); a block holding other bytes goes through the UTF-8 path
+       - the UTF-8 path maps code points with tables covering Latin-1, Latin Extended-A, Greek and Cyrillic;
+         only mappings keeping the encoded length are applied (e.g. 'ß' and 'İ' are left as they are), so the
+         string is rewritten in place; invalid sequences are left untouched
+       - the results do not depend on the C locale
+    */
+    class TextTransform {
+    public:
+        static void upper(std::string &s);
+
+        static void lower(std::string &s);
+
+        // uppercase the first letter of each word (any non-letter separates words), or of the string only
+        static void capitalize(std::string &s, bool firstOnly, bool forceLower);
+
+        // remove ASCII whitespace (" \t\n\v\f\r") from the chosen ends
+        static void trim(std::string &s, bool left, bool right);
+
+        // name of the kernel selected for this CPU ("avx2", "sse2" or "scalar")
+        static const char *implementation() noexcept;
+    };
+} // namespace jz
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <iostream>
+#include <string_view>
+
+// minimal checks for the test programs: a failed check is reported on stderr and the program carries on;
+// the exit code tells whether any failed
+namespace jz::test {
+    inline int failures = 0;
+
+    inline bool check(const bool ok, const std::string_view what) {
+        if (!ok) {
+            ++failures;
+            std::cerr << "FAIL: " << what << '\n';
+        }
+        return ok;
+    }
+
+    // exit code of the test program
+    inline int result() {
+        if (failures) std::cerr << failures << " check(s) failed\n";
+        return failures ? 1 : 0;
+    }
+} // namespace jz::test
@@ -0,0 +1,81 @@
+/*
+ LazyDocument tests: rendering against a lazy document gives what rendering against the parsed document gives
+ - documents whose strings hold escaped quotes, backslashes and brackets (the structural scanner must not take
+   them for the end of a string or of a container)
+ - keys with escapes (looked up by their decoded text) and repeated keys (the last one wins, as in parse)
+ - the same through a file opened with LazyDocument::open
+*/
+#include "Check.hpp"
+#include "../src/JZParser.hpp"
+#include "../src/LazyDocument.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+struct Case {
+    string document;
+    vector<string> templates;
+};
+
+static const vector<Case> CASES = {
+    // escaped quotes and backslashes in strings, before and inside nested values
+    {R"({"a": "say \"hi\"", "b": {"c": "\\", "d": ["\"", "\\\"", "x\\\\"]}, "e": 1})",
+     {"$(.)", "$(a)", "$(b)", "$(b.c)", "$(b.d)", "$(b.d[1])", "$(e)", R"({ "v": $(b.d[2]), "w": $(e) })"}},
+    // brackets and braces inside strings, as keys and values
+    {R"({"x": "]}", "y": ["[", "{", "}]", {"z": "}}]]"}], "w": {"[": "{", "k": [1, "]", 2]}, "end": true})",
+     {"$(.)", "$(x)", "$(y)", "$(y[3].z)", "$(w)", R"($(w["["]))", "$(w.k[2])", "$(end)"}},
+    // keys with escapes: unicode escapes, escaped quotes, backslashes
+    {R"({"m": {"caf\u00e9": 1, "q\"k": {"in\\ner": [true, null]}, "tab\tkey": "t", "plain": "p"}})",
+     {"$(.)", R"($(m["café"]))", R"($(m["q\"k"]))", R"($(m["q\"k"]["in\\ner"]))", R"($(m["tab\tkey"]))",
+      "$(m.plain)"}},
+    // repeated keys: the last one is kept, nested ones included
+    {R"({"k": 1, "o": {"k": "first", "k": "second"}, "k": [1, 2], "a": [{"k": 0, "k": {"v": 3}}]})",
+     {"$(.)", "$(k)", "$(o)", "$(o.k)", "$(a[0].k)", "$(a[0].k.v)", R"({ "k": $(k), "o": $(o.k) })"}},
+    // whitespace around everything, empty containers, numbers of each kind
+    {"  \n{ \"e\" : { } , \"f\" : [ ] , \"n\" : [ -1 , 2 , 3.5 , 1e3 , 18446744073709551615 ] }\r\n ",
+     {"$(.)", "$(e)", "$(f)", "$(n)", "$(n[0])", "$(n[4])", "$(missing)"}},
+};
+
+static string render_eager(const string &jz, const ordered_json &data) {
+    json metadata = json::object();
+    try {
+        return Processor::to_json(jz, data, metadata).dump();
+    } catch (const JZError &e) {
+        return string("error: ") + e.what();
+    }
+}
+
+static string render_lazy(const string &jz, const LazyDocument &data) {
+    json metadata = json::object();
+    try {
+        return Processor::to_json(jz, data, metadata).dump();
+    } catch (const JZError &e) {
+        return string("error: ") + e.what();
+    }
+}
+
+int main() {
+    for (const auto &[document, templates]: CASES) {
+        const ordered_json eager = ordered_json::parse(document);
+        const LazyDocument lazy = LazyDocument::from_string(document);
+
+        const string path = "jz-lazy-document-test.json";
+        ofstream(path, ios::binary) << document;
+        const LazyDocument mapped = LazyDocument::open(path);
+
+        for (const string &jz: templates) {
+            const string expected = render_eager(jz, eager);
+            check(render_lazy(jz, lazy) == expected, "lazy string: " + jz + " on " + document);
+            check(render_lazy(jz, mapped) == expected, "lazy file: " + jz + " on " + document);
+        }
+        check(lazy.materialize(lazy.root()) == eager, "materialized root of " + document);
+        remove(path.c_str());
+    }
+    return jz::test::result();
+}
@@ -0,0 +1,120 @@
+/*
+ render_ndjson tests: records come out in input order whatever order they finish in, and failing records
+ are reported with their input line number
+ - render times vary per record, the reorder window is smaller than the pool's backlog
+ - blank lines (skipped, but counted as lines), CRLF line ends, invalid JSON, tool errors, undefined results
+*/
+#include "Check.hpp"
+#include "../src/JZParser.hpp"
+#include "../src/NdjsonBatch.hpp"
+#include "../src/ThreadPool.hpp"
+#include "../src/ToolsManager.hpp"
+
+#include <chrono>
+#include <format>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+static constexpr size_t RECORDS = 2000;
+
+struct Expected {
+    string input;
+    string output; // lines, in order
+    vector<size_t> error_lines;
+    size_t written = 0;
+    size_t undefined = 0;
+};
+
+// record k: a plain record, or every so often invalid JSON, a record the tool rejects, an undefined result
+static Expected make_input() {
+    Expected e;
+    size_t line = 0;
+    for (size_t k = 0; k < RECORDS; ++k) {
+        if (k % 100 == 50) {
+            e.input += k % 200 == 50 ? "\n" : "  \t\n";
+            ++line;
+        }
+        ++line;
+        if (k % 97 == 13) {
+            e.input += "{\"rec\": {\"id\": " + to_string(k) + "\n";
+            e.error_lines.push_back(line);
+        } else if (k % 89 == 7) {
+            e.input += "{\"rec\": {\"id\": " + to_string(k) + ", \"fail\": true}}\n";
+            e.error_lines.push_back(line);
+        } else if (k % 83 == 5) {
+            e.input += "{\"other\": " + to_string(k) + "}\n";
+            ++e.undefined;
+        } else {
+            e.input += "{\"rec\": {\"id\": " + to_string(k) + "}}" + (k % 10 == 3 ? "\r\n" : "\n");
+            e.output += "{\"id\":" + to_string(k) + ",\"seen\":true}\n";
+            ++e.written;
+        }
+    }
+    return e;
+}
+
+static void register_probe() {
+    // sleeps a little, differently per record, so that records finish out of order
+    ToolsManager::instance().register_tool("probe", [](const ordered_json &input, const ordered_json &,
+                                                       const ordered_json &, json &) {
+        const auto id = input.at("id").get<size_t>();
+        this_thread::sleep_for(chrono::microseconds(id % 7 * 40));
+        if (input.contains("fail")) throw runtime_error(std::format("record {} rejected", id));
+        ordered_json out = input;
+        out["seen"] = true;
+        return out;
+    });
+}
+
+static vector<size_t> reported_lines(const string &errors, bool &well_formed) {
+    vector<size_t> lines;
+    istringstream in(errors);
+    string line;
+    well_formed = true;
+    while (getline(in, line)) {
+        size_t n = 0, pos = 0;
+        if (line.rfind("line ", 0) != 0 || (n = stoul(line.substr(5), &pos)) == 0 || line.compare(5 + pos, 2, ": ") != 0)
+            well_formed = false;
+        lines.push_back(n);
+    }
+    return lines;
+}
+
+static void run(const CompiledTemplate &compiled, const Expected &expected, const size_t window, ThreadPool *pool) {
+    istringstream in(expected.input);
+    ostringstream out, errors;
+    NdjsonOptions options;
+    options.window = window;
+    options.errors = &errors;
+    options.pool = pool;
+    const NdjsonStats stats = render_ndjson(compiled, in, out, options);
+
+    const string what = std::format("window {}", window);
+    check(out.str() == expected.output, "output in input order, " + what);
+    bool well_formed;
+    check(reported_lines(errors.str(), well_formed) == expected.error_lines, "error line numbers, " + what);
+    check(well_formed, "error lines as \"line <n>: <message>\", " + what);
+    check(errors.str().find("record 7 rejected") != string::npos, "tool errors are reported, " + what);
+    check(stats.records == RECORDS, "records counted, " + what);
+    check(stats.written == expected.written, "written counted, " + what);
+    check(stats.undefined == expected.undefined, "undefined counted, " + what);
+    check(stats.errors == expected.error_lines.size(), "errors counted, " + what);
+    check(stats.bytes_in == expected.input.size(), "input bytes counted, " + what);
+    check(stats.bytes_out == expected.output.size(), "output bytes counted, " + what);
+}
+
+int main() {
+    register_probe();
+    const CompiledTemplate compiled = Processor::compile("$(rec | #probe)");
+    const Expected expected = make_input();
+    ThreadPool pool(4);
+    for (const size_t window: {1, 3, 16, 1024}) run(compiled, expected, window, &pool);
+    run(compiled, expected, 64, nullptr);
+    return jz::test::result();
+}
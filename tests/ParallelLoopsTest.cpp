@@ -0,0 +1,156 @@
+/*
+ Parallel tool loop tests: a loop rendered on the thread pool gives the output and error of the same loop
+ rendered one item after the other, and its metadata when the tools only write it
+ - `$` and anonymous loops, with index / key bindings, nested loops, the policy and the per-loop option
+ - tools appending to and setting metadata, failing items; a tool reading metadata sees only its item's
+ - ThreadPool::parallel_for: every index once, nested calls, exceptions
+*/
+#include "Check.hpp"
+#include "../src/JZParser.hpp"
+#include "../src/ThreadPool.hpp"
+#include "../src/ToolsManager.hpp"
+
+#include <atomic>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+struct Outcome {
+    ordered_json output;
+    json metadata;
+    string error;
+
+    bool operator==(const Outcome &) const = default;
+};
+
+static Outcome render(const string &jz, const ordered_json &data, json metadata = json()) {
+    Outcome o;
+    try {
+        o.output = Processor::to_json(jz, data, metadata);
+    } catch (const exception &e) {
+        o.error = e.what();
+    }
+    o.metadata = std::move(metadata);
+    return o;
+}
+
+// the same template with the loop forced sequential ("false") and parallel ("true")
+static void same_outcome(const string &jz, const ordered_json &data, const json &metadata = json()) {
+    const auto with = [&](const string_view parallel) {
+        string s = jz;
+        for (size_t at; (at = s.find("PARALLEL")) != string::npos;) s.replace(at, 8, parallel);
+        return s;
+    };
+    const Outcome sequential = render(with("false"), data, metadata), parallel = render(with("true"), data, metadata);
+    check(parallel == sequential, std::format("{} (metadata {}): parallel {} / {} / {}, sequential {} / {} / {}",
+                                              jz, metadata.dump(), parallel.output.dump(), parallel.metadata.dump(),
+                                              parallel.error, sequential.output.dump(), sequential.metadata.dump(),
+                                              sequential.error));
+}
+
+static void register_tools() {
+    ToolsManager &tm = ToolsManager::instance();
+    // appends its input to metadata.log
+    tm.register_tool("log", [](const ordered_json &input, const ordered_json &, const ordered_json &, json &metadata) {
+        metadata["log"].push_back(json::parse(input.dump()));
+        return input;
+    });
+    // counts the calls in metadata.n (reading what the calls before left), returns the count
+    tm.register_tool("count", [](const ordered_json &, const ordered_json &, const ordered_json &, json &metadata) {
+        metadata["n"] = metadata.value("n", 0) + 1;
+        return ordered_json(metadata["n"]);
+    });
+    // fails on 3 and 7, records the last input it accepted
+    tm.register_tool("pick", [](const ordered_json &input, const ordered_json &, const ordered_json &, json &metadata) {
+        if (input == 3 || input == 7) throw runtime_error(std::format("item {} rejected", input.dump()));
+        metadata["last"] = json::parse(input.dump());
+        return input;
+    });
+}
+
+static void loops() {
+    ordered_json data;
+    data["name"] = "jz";
+    for (int i = 0; i < 1000; ++i) data["xs"].push_back(i);
+    for (int i = 0; i < 10; ++i) data["ys"].push_back({{"id", i}, {"tag", std::format("t{}", i)}});
+    for (int i = 0; i < 40; ++i) data["wide"][std::format("k{}", i)] = i;
+
+    same_outcome(R"($(xs | #(parallel=PARALLEL){ $(. | #upper) }))", data);
+    same_outcome(R"($(ys | #(parallel=PARALLEL, index="i"){ { "i": $(i), "tag": $(tag | #upper) } }))", data);
+    same_outcome(R"($(xs | #$($parallel=PARALLEL, $key="x"){ { "x": $(x), "name": $(name), "k": $(wide.k39) } }))", data);
+    same_outcome(R"($(ys | #$($parallel=PARALLEL, $index="i"){ { "id": $(id), "i": $(i), "k": $(wide.k7) } }))", data);
+    // nested loops over the same data
+    same_outcome(R"($(ys | #$($parallel=PARALLEL, $key="y"){ $(xs | #$($parallel=PARALLEL, $key="x"){ $(wide.k3) }) }))",
+                 data);
+
+    // metadata written by the items, with an empty and a non-empty starting metadata
+    for (const json &metadata: {json(), json::object(), json{{"pre", 1}}, json{{"log", {-1}}}}) {
+        same_outcome(R"($(xs | #(parallel=PARALLEL){ $(. | #log) }))", data, metadata);
+        same_outcome(R"($(ys | #$($parallel=PARALLEL, $key="y"){ $(y.id | #log) }))", data, metadata);
+        same_outcome(R"($(xs | #(parallel=PARALLEL){ $(. | #pick) }))", data, metadata);
+    }
+    const Outcome logged = render(R"($(xs | #(parallel=true){ $(. | #log) }))", data, {{"pre", 1}});
+    check(logged.metadata["pre"] == 1 && logged.metadata["log"].size() == 1000 && logged.metadata["log"][999] == 999,
+          "every item's metadata is merged onto the loop's: " + logged.metadata.dump().substr(0, 80));
+
+    // each item reads only its own metadata: a counter restarts from nothing in every item
+    const Outcome counted = render(R"($(xs | #(parallel=true){ $(. | #count) }))", data, {{"n", 10}});
+    check(counted.output == ordered_json(vector<int>(1000, 1)) && counted.metadata["n"] == 1,
+          "parallel items do not see the loop's metadata: " + counted.metadata.dump());
+    const Outcome sequential = render(R"($(xs | #(parallel=false){ $(. | #count) }))", data, {{"n", 10}});
+    check(sequential.output[999] == 1010 && sequential.metadata["n"] == 1010, "parallel=false keeps the counter");
+
+    // the policy turns loops parallel, the option turns one off
+    Processor::set_parallel_loops(true, 2);
+    same_outcome(R"($(xs | #{ $(. | #log) }))", data);
+    same_outcome(R"($(xs | #(parallel=false){ $(. | #pick) }))", data);
+    check(render(R"($(xs | #(parallel=false){ $(. | #count) }))", data, json::object()).metadata["n"] == 1000,
+          "the option turns the policy off");
+    Processor::set_parallel_loops(false);
+}
+
+static void thread_pool() {
+    ThreadPool pool(3);
+    for (const size_t count: {0, 1, 2, 7, 1000}) {
+        vector<atomic<int>> seen(count);
+        pool.parallel_for(count, [&](const size_t i) { seen[i].fetch_add(1); });
+        bool once = true;
+        for (const auto &s: seen) once = once && s.load() == 1;
+        check(once, std::format("parallel_for({}) runs every index once", count));
+    }
+
+    atomic<size_t> inner{0};
+    pool.parallel_for(16, [&](size_t) {
+        pool.parallel_for(64, [&](size_t) { inner.fetch_add(1); });
+    });
+    check(inner.load() == 16 * 64, "nested parallel_for");
+
+    atomic<size_t> ran{0};
+    try {
+        pool.parallel_for(100, [&](const size_t i) {
+            ran.fetch_add(1);
+            if (i == 42) throw runtime_error("item 42");
+        });
+        check(false, "parallel_for rethrows");
+    } catch (const runtime_error &e) {
+        check(string(e.what()) == "item 42", "parallel_for rethrows the item's exception");
+    }
+    check(ran.load() >= 1, "parallel_for ran items before rethrowing");
+
+    atomic<int> submitted{0};
+    for (int i = 0; i < 100; ++i) pool.submit([&submitted] { submitted.fetch_add(1); });
+    while (submitted.load() < 100) this_thread::yield();
+    check(submitted.load() == 100, "submitted tasks run");
+}
+
+int main() {
+    register_tools();
+    loops();
+    thread_pool();
+    return jz::test::result();
+}
@@ -0,0 +1,104 @@
+/*
+ RegexCache tests: the literal engine (substring search) against std::regex for the patterns it takes over
+ - anchors, escaped metacharacters (an escaped '$' at the end), overlapping candidates, empty input
+ - search, extract, extract_all and replace (first / every match, plain and '$' formats)
+*/
+#include "Check.hpp"
+#include "../src/RegexCache.hpp"
+
+#include <format>
+#include <iterator>
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+static const vector<string> LITERAL_PATTERNS = {
+    "abc", "^abc", "abc$", "^abc$", "aa", "^a", "a$", R"(a\$)", R"(^a\$)", R"(a\\$)", R"(\.)", R"(a\.b)",
+    R"(^\^)", R"(\$$)", R"(\(x\))", R"(\[\]\{\}\|\?\*\+)", "x y"
+};
+
+static const vector<string> SUBJECTS = {
+    "", "a", "abc", "xabc", "abcx", "abcabc", "aaaa", "a$", "xa$", R"(a\)", "a.b", "axb", "^^", "$$", "abc\nabc",
+    "(x)", "[]{}|?*+", "x y x y"
+};
+
+static vector<string> std_extract_all(const regex &re, const string &s) {
+    vector<string> out;
+    for (sregex_iterator it(s.begin(), s.end(), re), end; it != end; ++it) out.push_back(it->str());
+    return out;
+}
+
+static string std_replace(const regex &re, const string &s, const string &format, const bool all) {
+    return regex_replace(s, re, format, all ? regex_constants::format_default : regex_constants::format_first_only);
+}
+
+static void literal_matches_std_regex() {
+    for (const string &pattern: LITERAL_PATTERNS) {
+        const Regex literal(pattern, "");
+        check(literal.engine() == Regex::Engine::LITERAL, std::format("/{}/ runs on the literal engine", pattern));
+        const regex re(pattern, regex::ECMAScript);
+        for (const string &s: SUBJECTS) {
+            const string at = std::format("/{}/ on \"{}\"", pattern, s);
+            smatch m;
+            const bool found = regex_search(s, m, re);
+            check(literal.search(s) == found, "search " + at);
+            const auto first = literal.extract(s, 0);
+            check(first.has_value() == found && (!found || *first == m.str()), "extract " + at);
+            check(literal.extract_all(s, 0) == std_extract_all(re, s), "extract_all " + at);
+            for (const string format: {"X", "", "[$&]", "$$"}) {
+                for (const bool all: {true, false}) {
+                    check(literal.replace(s, format, all) == std_replace(re, s, format, all),
+                          std::format("replace {} with \"{}\" (all: {})", at, format, all));
+                }
+            }
+        }
+    }
+}
+
+static void engine_selection() {
+    // metacharacters, classes and flags need std::regex
+    for (const string pattern: {"a.c", "a|b", "a*", "(a)", R"(\d)", R"(\w+)", R"(\bx)", "[ab]", "^$", "", R"(a\)"}) {
+        try {
+            check(Regex(pattern, "").engine() == Regex::Engine::STD, std::format("/{}/ runs on std::regex", pattern));
+        } catch (const regex_error &) {
+            check(pattern == R"(a\)", std::format("/{}/ compiles", pattern));
+        }
+    }
+    check(Regex("abc", "i").engine() == Regex::Engine::STD, "flags run on std::regex");
+    check(Regex("abc", "i").search("xABCx"), "ignore case");
+    check(Regex("^b$", "m").search("a\nb\nc"), "multiline anchors");
+    try {
+        (void) Regex("abc", "g");
+        check(false, "an unknown flag throws");
+    } catch (const invalid_argument &) {
+    }
+    try {
+        (void) Regex("abc", "").extract("abc", 1);
+        check(false, "a missing group throws");
+    } catch (const invalid_argument &) {
+    }
+}
+
+static void cache() {
+    RegexCache &cache = RegexCache::instance();
+    cache.set_capacity(2);
+    cache.clear();
+    const auto a = cache.get("a+");
+    check(cache.get("a+") == a, "a cached pattern is shared");
+    check(cache.get("a+", "i") != a, "flags are part of the key");
+    (void) cache.get("b+");
+    check(cache.stats().entries == 2, "the capacity bounds the entries");
+    check(cache.get("a+") != a, "the least recently used pattern is evicted");
+    cache.set_capacity(RegexCache::DEFAULT_CAPACITY);
+}
+
+int main() {
+    literal_matches_std_regex();
+    engine_selection();
+    cache();
+    return jz::test::result();
+}
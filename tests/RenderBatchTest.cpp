@@ -0,0 +1,119 @@
+/*
+ render_batch tests: each result is what rendering its document alone gives, in input order
+ - render times vary per document (documents finish out of order on the pool)
+ - a tool throwing for some documents: their results carry their own error, the other documents still render
+ - every document starts from a copy of the batch metadata and keeps what its own render wrote
+ - undefined members, an empty batch, a template that does not compile
+*/
+#include "Check.hpp"
+#include "../src/JZParser.hpp"
+#include "../src/ToolsManager.hpp"
+
+#include <chrono>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+static constexpr int DOCUMENTS = 500;
+
+static const string TEMPLATE = R"({"id": $(id | #wait | #reject | #note), "name": $(name)})";
+
+struct Outcome {
+    ordered_json output;
+    json metadata;
+    string error;
+
+    bool operator==(const Outcome &) const = default;
+};
+
+static void register_tools() {
+    ToolsManager &tm = ToolsManager::instance();
+    // sleeps a little for some ids, so that later documents finish first
+    tm.register_tool("wait", [](const ordered_json &input, const ordered_json &, const ordered_json &, json &) {
+        if (input.is_number() && input.get<int>() % 10 == 0) this_thread::sleep_for(chrono::milliseconds(2));
+        return input;
+    });
+    // rejects ids ending in 3, naming the id
+    tm.register_tool("reject", [](const ordered_json &input, const ordered_json &, const ordered_json &, json &) {
+        if (input.is_number() && input.get<int>() % 10 == 3)
+            throw runtime_error(std::format("document {} rejected", input.dump()));
+        return input;
+    });
+    // records the id in metadata.seen
+    tm.register_tool("note", [](const ordered_json &input, const ordered_json &, const ordered_json &, json &metadata) {
+        metadata["seen"].push_back(json::parse(input.dump()));
+        return input;
+    });
+}
+
+// document k: an id and a name, or (every so often) no id, left out of the output
+static vector<ordered_json> make_documents() {
+    vector<ordered_json> documents;
+    for (int k = 0; k < DOCUMENTS; ++k) {
+        if (k % 50 == 25) documents.push_back({{"name", std::format("n{}", k)}});
+        else documents.push_back({{"id", k}, {"name", std::format("n{}", k)}});
+    }
+    return documents;
+}
+
+static Outcome render_alone(const ordered_json &document, json metadata) {
+    Outcome o;
+    try {
+        o.output = Processor::to_json(TEMPLATE, document, metadata);
+    } catch (const exception &e) {
+        o.output = nullptr;
+        o.error = e.what();
+    }
+    o.metadata = std::move(metadata);
+    return o;
+}
+
+static void batch_matches_documents_alone() {
+    const vector<ordered_json> documents = make_documents();
+    const json metadata = {{"batch", "b1"}};
+    const vector<BatchResult> results = Processor::render_batch(TEMPLATE, documents, metadata);
+    if (!check(results.size() == documents.size(), "one result per document")) return;
+
+    size_t failed = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const BatchResult &r = results[i];
+        const Outcome expected = render_alone(documents[i], metadata);
+        check(Outcome{r.output, r.metadata, r.error_message()} == expected,
+              std::format("document {}: {} / {} / {}", i, r.output.dump(), r.metadata.dump(), r.error_message()));
+        check(r.ok() == expected.error.empty(), std::format("document {}: ok()", i));
+        if (!r.ok()) {
+            ++failed;
+            check(r.error_message().find(std::format("document {} rejected", i)) != string::npos,
+                  std::format("document {} carries its own error: {}", i, r.error_message()));
+        }
+    }
+    check(failed == DOCUMENTS / 10, std::format("{} documents failed", failed));
+    check(results[25].output == ordered_json({{"name", "n25"}}) && results[25].metadata == metadata,
+          "document 25: undefined id left out, its tools not run");
+    check(results[1].output == ordered_json({{"id", 1}, {"name", "n1"}}), "output of document 1");
+    check(results[1].metadata == json({{"batch", "b1"}, {"seen", {1}}}), "metadata of document 1");
+}
+
+static void edge_cases() {
+    check(Processor::render_batch(TEMPLATE, vector<ordered_json>()).empty(), "empty batch");
+    bool thrown = false;
+    try {
+        (void) Processor::render_batch("$(unterminated", make_documents());
+    } catch (const JZError &) {
+        thrown = true;
+    }
+    check(thrown, "a template that does not compile throws");
+}
+
+int main() {
+    register_tools();
+    batch_matches_documents_alone();
+    edge_cases();
+    return jz::test::result();
+}
@@ -0,0 +1,99 @@
+/*
+ Streaming render tests: the text written to an OutputSink is byte for byte dump() of the JSON render
+ - undefined members and elements (left out, with their separators), an undefined result (nothing written)
+ - objects that cannot be streamed member by member (computed or repeated keys), nested in streamed ones
+ - escapes and non-ASCII text in strings and keys, numbers, tool loops, strings longer than a chunk
+ - chunk sizes of 1 byte, a few bytes and the default; streamed render_string against render_string
+*/
+#include "Check.hpp"
+#include "../src/JZParser.hpp"
+
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+static const vector<string> TEMPLATES = {
+    // undefined members and elements, first, in the middle and last
+    R"({"a": $(missing), "b": $(name), "c": $(missing), "d": [$(missing), 1, $(missing), $(nums), $(missing)]})",
+    R"([$(missing)])",
+    R"({"only": $(missing)})",
+    // computed and repeated keys: built whole, inside streamed containers
+    R"({"before": 1, "inner": { $(name): $(nums), "k": $(missing) }, "after": [{"a": 1, "a": 2}]})",
+    R"({ $(name): 1, "x": $(user) })",
+    R"({"a": 1, "b": 2, "a": $(missing)})",
+    // escapes, non-ASCII text, keys needing escapes
+    R"({"quote\"key": $(text), "é": "€\n\t\\", "emoji": "😀", "ctrl": "\u0001"})",
+    // numbers, constants, nested values from the data
+    R"({"n": [0, -1, 1.5, 1e300, 18446744073709551615, true, false, null], "user": $(user), "all": $(.)})",
+    // tool loops and pipelines
+    R"({"upper": $(words | #(index="i"){ { "i": $(i), "w": $(. | #upper) } }), "name": $(name | #upper)})",
+    // strings longer than a chunk
+    R"({"long": $(long), "twice": [$(long), $(long)]})",
+    // the whole data, a single value, an undefined result
+    "$(.)",
+    "$(nums)",
+    "$(missing)",
+};
+
+static ordered_json make_data() {
+    ordered_json data;
+    data["name"] = "jz";
+    data["nums"] = {1, 2.5, -3};
+    data["text"] = "line\nwith \"quotes\" and \\ and é";
+    data["user"] = {{"first", "Ada"}, {"tags", ordered_json::array()}, {"meta", ordered_json::object()}};
+    data["words"] = {"alpha", "béta", "gamma"};
+    data["long"] = string(200, 'x') + "€" + string(100, 'y');
+    return data;
+}
+
+static void streamed_equals_dump(const string &jz, const ordered_json &data, const size_t chunk_size) {
+    const string at = std::format("{} (chunk size {})", jz, chunk_size);
+
+    json metadata = json::object();
+    const ordered_json rendered = Processor::to_json(jz, data, metadata);
+    const bool undefined = Processor::is_undefined(rendered);
+
+    string streamed;
+    size_t chunks = 0;
+    OutputSink sink([&](const string_view chunk) {
+        streamed += chunk;
+        ++chunks;
+    }, chunk_size);
+    json streamed_metadata = json::object();
+    const bool defined = Processor::to_json(jz, data, streamed_metadata, sink);
+
+    check(defined == !undefined, "defined: " + at);
+    check(streamed == (undefined ? string() : rendered.dump()), "streamed: " + at + "\n  " + streamed);
+    check(sink.size() == streamed.size(), "sink size: " + at);
+    check(streamed_metadata == metadata, "metadata: " + at);
+    if (chunk_size == 1 && streamed.size() > 1) check(chunks > 1, "written in chunks: " + at);
+
+    // the compiled template streams the same text
+    string compiled_streamed;
+    OutputSink compiled_sink([&](const string_view chunk) { compiled_streamed += chunk; }, chunk_size);
+    json compiled_metadata = json::object();
+    Processor::compile(jz).render(data, compiled_metadata, compiled_sink);
+    check(compiled_streamed == streamed, "compiled: " + at);
+
+    // and the text render
+    json text_metadata = json::object();
+    const string text = Processor::to_string(jz, data, text_metadata);
+    string text_streamed;
+    OutputSink text_sink([&](const string_view chunk) { text_streamed += chunk; }, chunk_size);
+    json text_streamed_metadata = json::object();
+    Processor::to_string(jz, data, text_streamed_metadata, text_sink);
+    check(text_streamed == text, "to_string: " + at);
+}
+
+int main() {
+    const ordered_json data = make_data();
+    for (const string &jz: TEMPLATES) {
+        for (const size_t chunk_size: {size_t{1}, size_t{7}, OutputSink::DEFAULT_CHUNK_SIZE})
+            streamed_equals_dump(jz, data, chunk_size);
+    }
+    return jz::test::result();
+}
@@ -0,0 +1,184 @@
+/*
+ String tool tests: split, substring, indexOf and replace against naive references over code point vectors
+ - positions in code points (é, €, 😀 are 2 to 4 bytes): start, end and length, negative and out of range
+ - split with a limit, skipEmpty and the empty separator (code points)
+ - replace on short inputs (string_view::find) and long ones with a long search (Boyer-Moore-Horspool), with
+   replacements of the same size (overwritten in place) and of other sizes, first occurrence or all
+*/
+#include "Check.hpp"
+#include "../src/ToolsManager.hpp"
+
+#include <format>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+static const vector<string> TEXTS = {
+    "", "a", "abc", "a,b,,c", ",a,", ",,", "héllo, wörld", "€,😀,,é", "😀😀😀", "a€b€€c", "x,y,z,"
+};
+
+static ordered_json run(const string &tool, const string &input, const ordered_json &options) {
+    json metadata = json::object();
+    return ToolsManager::instance().run_tool(tool, input, options, ordered_json(), metadata);
+}
+
+// code points, by their first byte (the test strings are valid UTF-8)
+static vector<string> code_points(const string &s) {
+    vector<string> out;
+    for (const char c: s) {
+        if ((static_cast<unsigned char>(c) & 0xC0) != 0x80 || out.empty()) out.emplace_back();
+        out.back() += c;
+    }
+    return out;
+}
+
+static string concat(const vector<string> &cps, const size_t from, const size_t to) {
+    string out;
+    for (size_t i = from; i < to && i < cps.size(); ++i) out += cps[i];
+    return out;
+}
+
+static size_t clamp(const long long index, const size_t length) {
+    const long long n = static_cast<long long>(length);
+    return static_cast<size_t>(index < 0 ? max(n + index, 0LL) : min(index, n));
+}
+
+// parts between separators; the limit-th part holds the rest of the string; empty parts skipped do not count
+static vector<string> split_reference(const string &s, const string &separator, const size_t limit,
+                                      const bool skip_empty) {
+    vector<string> pieces;
+    vector<size_t> starts;
+    if (separator.empty()) {
+        size_t offset = 0;
+        for (const string &cp: code_points(s)) {
+            starts.push_back(offset);
+            pieces.push_back(cp);
+            offset += cp.size();
+        }
+    } else {
+        size_t start = 0;
+        for (size_t next; (next = s.find(separator, start)) != string::npos; start = next + separator.size()) {
+            starts.push_back(start);
+            pieces.push_back(s.substr(start, next - start));
+        }
+        starts.push_back(start);
+        pieces.push_back(s.substr(start));
+    }
+    vector<string> parts;
+    for (size_t k = 0; k < pieces.size(); ++k) {
+        const bool rest = limit != 0 && parts.size() + 1 >= limit;
+        const string part = rest ? s.substr(starts[k]) : pieces[k];
+        if (!skip_empty || !part.empty()) parts.push_back(part);
+        if (rest) break;
+    }
+    return parts;
+}
+
+static void split_matches_reference() {
+    for (const string &s: TEXTS) {
+        for (const string separator: {",", ",,", "", "€", "😀", "xyz"}) {
+            for (const size_t limit: {0, 1, 2, 3, 10}) {
+                for (const bool skip_empty: {false, true}) {
+                    ordered_json options = {{"separator", separator}, {"skipEmpty", skip_empty}};
+                    if (limit) options["limit"] = limit;
+                    const auto expected = split_reference(s, separator, limit, skip_empty);
+                    check(run("split", s, options) == ordered_json(expected),
+                          std::format("split \"{}\" {}", s, options.dump()));
+                }
+            }
+        }
+    }
+    check(run("split", "a,b", ordered_json::object()) == ordered_json({"a", "b"}), "split: ',' by default");
+}
+
+static void substring_matches_reference() {
+    const vector<long long> positions = {-10, -4, -3, -1, 0, 1, 2, 3, 4, 10};
+    for (const string &s: TEXTS) {
+        const vector<string> cps = code_points(s);
+        const size_t n = cps.size();
+        for (const long long start: positions) {
+            const size_t begin = clamp(start, n);
+            check(run("substring", s, {{"start", start}}) == concat(cps, begin, n),
+                  std::format("substring \"{}\" start {}", s, start));
+            for (const long long end: positions) {
+                check(run("substring", s, {{"start", start}, {"end", end}}) == concat(cps, begin, clamp(end, n)),
+                      std::format("substring \"{}\" start {} end {}", s, start, end));
+            }
+            for (const long long length: {-1LL, 0LL, 1LL, 2LL, 100LL}) {
+                const size_t to = length > 0 ? begin + static_cast<size_t>(length) : begin;
+                check(run("substring", s, {{"start", start}, {"length", length}}) == concat(cps, begin, to),
+                      std::format("substring \"{}\" start {} length {}", s, start, length));
+            }
+        }
+    }
+    // a multi-byte code point is kept or dropped whole
+    check(run("substring", "a😀b", {{"start", 1}, {"length", 1}}) == "😀", "substring: 4-byte code point");
+    check(run("substring", "é€😀", {{"start", -2}}) == "€😀", "substring: from the end over multi-byte code points");
+}
+
+// code point index of the first occurrence from code point `from`, -1 when none
+static long long index_of_reference(const string &s, const string &search, const long long from) {
+    const vector<string> cps = code_points(s);
+    for (size_t i = clamp(from, cps.size()); i <= cps.size(); ++i) {
+        if (concat(cps, i, cps.size()).starts_with(search)) return static_cast<long long>(i);
+    }
+    return -1;
+}
+
+static void index_of_matches_reference() {
+    for (const string &s: TEXTS) {
+        for (const string search: {"", ",", "b", "€", "😀", "llo", "😀😀", "zz"}) {
+            for (const long long from: {-100LL, -3LL, -1LL, 0LL, 1LL, 2LL, 4LL, 100LL}) {
+                check(run("indexOf", s, {{"search", search}, {"from", from}}) == index_of_reference(s, search, from),
+                      std::format("indexOf \"{}\" in \"{}\" from {}", search, s, from));
+            }
+        }
+    }
+}
+
+static string replace_reference(const string &s, const string &search, const string &replacement, const bool all) {
+    if (search.empty()) return s;
+    string out;
+    size_t last = 0;
+    for (size_t pos; (pos = s.find(search, last)) != string::npos;) {
+        out += s.substr(last, pos - last) + replacement;
+        last = pos + search.size();
+        if (!all) break;
+    }
+    return out + s.substr(last);
+}
+
+static void replace_matches_reference() {
+    // long inputs reach the searcher: occurrences at both ends, overlapping candidates, none at all
+    string long_text;
+    for (int i = 0; long_text.size() < 600; ++i) long_text += i % 7 == 0 ? "needle" : i % 5 == 0 ? "neeneedle" : "hay€";
+    const vector<string> texts = {
+        "", "abc", "aaaaaaaaa", "needle", "a needle, a needle", "é€😀é€😀", long_text, "needle" + long_text + "needle",
+        string(300, 'a'), string(300, 'x')
+    };
+    const vector<string> searches = {"", "a", "aa", "aaaa", "needle", "neeneedle", "€😀", "é€😀é", "missing!"};
+    const vector<string> replacements = {"", "X", "NEEDLE", "ab", "€€", "longer replacement"};
+    for (const string &s: texts) {
+        for (const string &search: searches) {
+            for (const string &replacement: replacements) {
+                for (const bool all: {true, false}) {
+                    const ordered_json options = {{"search", search}, {"replacement", replacement}, {"all", all}};
+                    check(run("replace", s, options) == replace_reference(s, search, replacement, all),
+                          std::format("replace in \"{}\" {}", s.substr(0, 40), options.dump()));
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    split_matches_reference();
+    substring_matches_reference();
+    index_of_matches_reference();
+    replace_matches_reference();
+    return jz::test::result();
+}
@@ -0,0 +1,118 @@
+/*
+ TemplateCache tests: a small budget filled and overflowed through Processor::to_json
+ - templates picked in the same shard, so that the shard budget decides what is evicted (least recently used)
+ - template_cache_stats(): entries, hits, misses and evictions after each step
+ - a template too big for a shard is compiled every time and never cached
+ - a cached template (first render and hits) renders what the uncached one renders
+*/
+#include "Check.hpp"
+#include "../src/JZParser.hpp"
+#include "../src/TemplateCache.hpp"
+
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+// bookkeeping bytes the cache adds to each entry (TemplateCache.cpp)
+static constexpr size_t ENTRY_OVERHEAD = 128;
+
+static const ordered_json DATA = {
+    {"name", "jz"}, {"items", {1, 2, 3}}, {"user", {{"first", "Ada"}, {"last", "Lovelace"}}}
+};
+
+static size_t shard_of(const string &jz) {
+    return std::hash<string_view>{}(jz) % TemplateCache::SHARDS;
+}
+
+static size_t entry_bytes(const string &jz) {
+    return ENTRY_OVERHEAD + jz.size() + Processor::compile(jz).memory_size();
+}
+
+static string render(const string &jz) {
+    json metadata = json::object();
+    return Processor::to_json(jz, DATA, metadata).dump();
+}
+
+static bool stats_are(const size_t entries, const uint64_t hits, const uint64_t misses, const uint64_t evictions,
+                      const string &step) {
+    const TemplateCacheStats st = Processor::template_cache_stats();
+    return check(st.entries == entries && st.hits == hits && st.misses == misses && st.evictions == evictions,
+                 std::format("{}: entries {} hits {} misses {} evictions {} (expected {} {} {} {})", step,
+                             st.entries, st.hits, st.misses, st.evictions, entries, hits, misses, evictions));
+}
+
+static void lru_in_a_shard() {
+    // three templates of the same shape hashed to the same shard
+    vector<string> templates;
+    for (int i = 0; templates.size() < 3; ++i) {
+        const string jz = R"({"n": $(name), "k": )" + to_string(1000 + i) + "}";
+        if (templates.empty() || shard_of(jz) == shard_of(templates[0])) templates.push_back(jz);
+    }
+    size_t largest = 0, smallest = SIZE_MAX;
+    for (const string &jz: templates) {
+        largest = max(largest, entry_bytes(jz));
+        smallest = min(smallest, entry_bytes(jz));
+    }
+    // any two fit in the shard, the three do not
+    check(3 * smallest > 2 * largest, "templates of similar sizes");
+    Processor::enable_template_cache(TemplateCache::SHARDS * 2 * largest);
+    TemplateCache::instance().reset_stats();
+
+    const string &a = templates[0], &b = templates[1], &c = templates[2];
+    render(a);
+    stats_are(1, 0, 1, 0, "a");
+    render(b);
+    stats_are(2, 0, 2, 0, "a b");
+    render(a);
+    stats_are(2, 1, 2, 0, "a b a");
+    render(c); // evicts b, the least recently used
+    stats_are(2, 1, 3, 1, "a b a c");
+    render(a);
+    stats_are(2, 2, 3, 1, "a b a c a");
+    render(b); // evicts c
+    stats_are(2, 2, 4, 2, "a b a c a b");
+    render(c);
+    stats_are(2, 2, 5, 3, "a b a c a b c");
+
+    // too big for a shard: compiled and rendered, but neither cached nor evicting anything
+    string big = R"({"big": ")" + string(4 * largest, 'x') + R"(", "n": $(name)})";
+    check(render(big) == render(big), "template too big for a shard renders");
+    stats_are(2, 2, 7, 3, "too big");
+
+    Processor::disable_template_cache();
+    stats_are(0, 2, 7, 3, "disabled (counters kept)");
+}
+
+static void cached_renders_as_uncached() {
+    const vector<string> templates = {
+        R"({"n": $(name), "first": $(user.first), "all": $(.)})",
+        R"({"count": $(items | #length), "upper": $(user.last | #upper)})",
+        R"~(["$(name)", `${user.first} ${user.last}`, $(missing)])~",
+        R"($(items | #(index="i"){ { "i": $(i), "v": $(.), "name": $(name) } }))",
+    };
+    vector<string> expected;
+    for (const string &jz: templates) expected.push_back(render(jz));
+
+    Processor::enable_template_cache();
+    TemplateCache::instance().reset_stats();
+    for (int round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < templates.size(); ++i) {
+            check(render(templates[i]) == expected[i], std::format("cached render of {} (round {})", templates[i],
+                                                                   round));
+        }
+    }
+    stats_are(templates.size(), 2 * templates.size(), templates.size(), 0, "renders of cached templates");
+    Processor::disable_template_cache();
+}
+
+int main() {
+    lru_in_a_shard();
+    cached_renders_as_uncached();
+    return jz::test::result();
+}
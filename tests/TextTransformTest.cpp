@@ -0,0 +1,141 @@
+/*
+ TextTransform tests: the SIMD kernels against byte-by-byte references
+ - case conversion of strings around the block sizes (16 and 32 bytes), with a non-ASCII character (or an
+   invalid byte) before, across and after each block edge
+ - trim of whitespace runs around the block sizes, with content bytes next to the whitespace range
+*/
+#include "Check.hpp"
+#include "../src/tools/TextTransform.hpp"
+
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jz;
+using jz::test::check;
+
+static const vector<size_t> LENGTHS = {1, 15, 16, 17, 31, 32, 33, 47, 48, 49, 63, 64, 65, 100};
+
+// ASCII bytes next to the letter ranges, the letters at their ends and a few others
+static constexpr string_view FILLER = "aZ@[`{zA m0N_~!";
+
+// non-ASCII characters (with and without a case mapping), a lead byte without its continuation and overlong
+// encodings of letters (invalid, left as they are)
+static const vector<string> NON_ASCII = {"é", "É", "ж", "Ж", "ß", "€", "😀", "\xC3", "\xC1\x81", "\xE0\x83\xA9"};
+
+static string ascii_upper(string s) {
+    for (char &c: s) if (c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+    return s;
+}
+
+static string ascii_lower(string s) {
+    for (char &c: s) if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    return s;
+}
+
+static string filler(const size_t from, const size_t n) {
+    string s;
+    for (size_t i = 0; i < n; ++i) s += FILLER[(from + i) % FILLER.size()];
+    return s;
+}
+
+static string converted(string s, void (*convert)(string &)) {
+    convert(s);
+    return s;
+}
+
+static string escaped(const string &s) {
+    string out;
+    for (const char c: s) {
+        if (static_cast<unsigned char>(c) < 0x20 || static_cast<unsigned char>(c) >= 0x80)
+            out += std::format("\\x{:02X}", static_cast<unsigned char>(c));
+        else out += c;
+    }
+    return out;
+}
+
+static void ascii_case() {
+    string all;
+    for (int c = 0; c < 0x80; ++c) all += static_cast<char>(c);
+    for (size_t n = 0; n <= all.size(); ++n) {
+        const string s = all.substr(0, n), rotated = all.substr(n) + s;
+        check(converted(s, TextTransform::upper) == ascii_upper(s), "upper of " + escaped(s));
+        check(converted(s, TextTransform::lower) == ascii_lower(s), "lower of " + escaped(s));
+        check(converted(rotated, TextTransform::upper) == ascii_upper(rotated), "upper of " + escaped(rotated));
+    }
+    for (const size_t n: LENGTHS) {
+        const string s = filler(0, n);
+        check(converted(s, TextTransform::upper) == ascii_upper(s), "upper of " + s);
+        check(converted(s, TextTransform::lower) == ascii_lower(s), "lower of " + s);
+    }
+}
+
+// the character is converted alone (shorter than a block: no kernel involved), the filler byte by byte
+static void non_ascii_at_block_edges() {
+    for (const size_t n: LENGTHS) {
+        for (const string &ch: NON_ASCII) {
+            for (const size_t at: {size_t{0}, size_t{14}, size_t{15}, size_t{16}, size_t{30}, size_t{31},
+                                   size_t{32}, size_t{33}, n > ch.size() ? n - ch.size() : 0}) {
+                if (at > n) continue;
+                const string before = filler(0, at), after = filler(at, n - at);
+                const string s = before + ch + after;
+                const string what = std::format("{} bytes, \"{}\" at {}", s.size(), escaped(ch), at);
+                check(converted(s, TextTransform::upper) ==
+                      ascii_upper(before) + converted(ch, TextTransform::upper) + ascii_upper(after), "upper, " + what);
+                check(converted(s, TextTransform::lower) ==
+                      ascii_lower(before) + converted(ch, TextTransform::lower) + ascii_lower(after), "lower, " + what);
+            }
+        }
+    }
+    check(converted("é", TextTransform::upper) == "É" && converted("Ж", TextTransform::lower) == "ж",
+          "Latin-1 and Cyrillic mappings");
+    check(converted("ß", TextTransform::upper) == "ß", "mappings changing the length are left out");
+    // "A" and "é" encoded on more bytes than needed: not decoded, so not mapped
+    for (const string overlong: {"\xC1\x81", "\xC0\xA1", "\xE0\x83\xA9", "\xF0\x80\x83\x89"}) {
+        check(converted(overlong, TextTransform::lower) == overlong &&
+              converted("x" + overlong + "y", TextTransform::upper) == "X" + overlong + "Y",
+              std::format("overlong \"{}\" left untouched", escaped(overlong)));
+    }
+}
+
+static string reference_trim(const string &s, const bool left, const bool right) {
+    static constexpr string_view SPACES = " \t\n\v\f\r";
+    size_t b = 0, e = s.size();
+    if (right) while (e > 0 && SPACES.find(s[e - 1]) != string_view::npos) --e;
+    if (left) while (b < e && SPACES.find(s[b]) != string_view::npos) ++b;
+    return s.substr(b, e - b);
+}
+
+static void trim_at_block_edges() {
+    static constexpr string_view SPACES = " \t\n\v\f\r";
+    const auto spaces = [](const size_t n) {
+        string s;
+        for (size_t i = 0; i < n; ++i) s += SPACES[i % SPACES.size()];
+        return s;
+    };
+    // \x08 and \x0E border the \t..\r range, \x1F and \x21 the space; é ends with a byte >= 0x80
+    const vector<string> contents = {"", "x", "\x08", "\x0E", "\x1F", "!", "é", "a b", "\x08 y \x0E", "é   é"};
+    for (const size_t lead: {0, 1, 15, 16, 17, 31, 32, 33, 64, 65}) {
+        for (const size_t tail: {0, 1, 15, 16, 17, 31, 32, 33, 64, 65}) {
+            for (const string &content: contents) {
+                const string s = spaces(lead) + content + spaces(tail);
+                for (const auto &[left, right]: {pair{true, true}, pair{true, false}, pair{false, true}}) {
+                    string trimmed = s;
+                    TextTransform::trim(trimmed, left, right);
+                    check(trimmed == reference_trim(s, left, right),
+                          std::format("trim (left: {}, right: {}) of {} + \"{}\" + {}", left, right, lead,
+                                      escaped(content), tail));
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    cout << "kernel: " << TextTransform::implementation() << '\n';
+    ascii_case();
+    non_ascii_at_block_edges();
+    trim_at_block_edges();
+    return jz::test::result();
+}